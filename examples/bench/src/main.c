@@ -0,0 +1,550 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <yell.h>
+
+#define MAX_NODES  (MAX_PORT - MIN_PORT)
+
+// how long to wait at a barrier, for the mesh, or for deliveries that stopped arriving
+#define BARRIER_TIMEOUT  30000
+#define MESH_TIMEOUT     10000
+#define DRAIN_TIMEOUT    5000
+
+// every message starts with the time it was sent
+#define STAMP_SIZE  sizeof(uint64_t)
+
+enum bench_workload {
+	BW_BROADCAST,
+	BW_UNICAST,
+	BW_GOSSIP,
+	BW_QUEUE,
+	BW_DATAGRAM
+};
+
+static const char *bench_workloads[] = { "broadcast", "unicast", "gossip", "queue", "datagram" };
+
+// options; every process has its own copy
+struct bench_options {
+	enum bench_workload workload;
+	int nodes, processes, senders, messages, size, verbose;
+};
+
+/* Results are shared by every process through an anonymous mapping made before forking;
+ * they are only ever added to with atomics, which work across processes as well as threads. */
+struct bench_shared {
+	_Atomic int port;                       // port of the first node, once it has started
+	_Atomic int started, meshed, armed, sent, finished;  // barriers
+	_Atomic int failed;
+
+	_Atomic uint64_t start_ns, end_ns;      // first send and last delivery
+	_Atomic uint64_t delivered, send_failures;
+	_Atomic uint64_t cpu_us, allocs;
+
+	struct yell_HG latency;                 // from send to delivery, in microseconds
+};
+
+// a node hosted by this process, and the thread that sends from it
+struct bench_node {
+	struct yell self;
+	int index;
+	pthread_t thread;
+};
+
+static struct bench_options  options;
+static struct bench_shared  *shared;
+
+/* Allocations are counted by wrapping malloc() and friends at link time (see the Makefile),
+ * which also catches those made inside libyell. */
+static _Atomic uint64_t allocs;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) {
+	atomic_fetch_add_explicit(&allocs, 1, memory_order_relaxed);
+
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size) {
+	atomic_fetch_add_explicit(&allocs, 1, memory_order_relaxed);
+
+	return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+	atomic_fetch_add_explicit(&allocs, 1, memory_order_relaxed);
+
+	return __real_realloc(ptr, size);
+}
+
+uint64_t bench_now(void) {
+	struct timespec now;
+
+	// the monotonic clock is shared by every process on the machine
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+uint64_t bench_cpu(void) {
+	struct rusage usage;
+
+	getrusage(RUSAGE_SELF, &usage);
+
+	return (uint64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000
+	     + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+// waits for every one of total to arrive; returns 0, or -1 if they didn't within BARRIER_TIMEOUT
+int bench_barrier(_Atomic int *counter, int total) {
+	uint64_t deadline = bench_now() + (uint64_t)BARRIER_TIMEOUT * 1000000;
+
+	atomic_fetch_add(counter, 1);
+
+	while (atomic_load(counter) < total) {
+		if (atomic_load(&shared->failed) || bench_now() > deadline) {
+			atomic_store(&shared->failed, 1);
+
+			return -1;
+		}
+
+		usleep(1000);
+	}
+
+	return 0;
+}
+
+void bench_min(_Atomic uint64_t *value, uint64_t n) {
+	uint64_t old = atomic_load(value);
+
+	while (n < old && !atomic_compare_exchange_weak(value, &old, n))
+		;
+}
+
+void bench_max(_Atomic uint64_t *value, uint64_t n) {
+	uint64_t old = atomic_load(value);
+
+	while (n > old && !atomic_compare_exchange_weak(value, &old, n))
+		;
+}
+
+// the number of deliveries expected once every sender is done
+uint64_t bench_expected(void) {
+	uint64_t expected = (uint64_t)options.senders * options.messages;
+
+	// a unicast reaches one peer; everything else reaches every peer
+	if (options.workload == BW_UNICAST)
+		return expected;
+
+	return expected * (options.nodes - 1);
+}
+
+int event_handler(struct yell *self, struct yell_event *event) {
+	uint64_t now, sent;
+
+	if (event->type == YET_MESSAGE && event->length >= STAMP_SIZE) {
+		now = bench_now();
+		memcpy(&sent, event->packet, STAMP_SIZE);
+
+		yell_HG_record(&shared->latency, now > sent ? (now - sent) / 1000 : 0);
+		bench_max(&shared->end_ns, now);
+
+		atomic_fetch_add_explicit(&shared->delivered, 1, memory_order_relaxed);
+	}
+
+	yell_freeevent(self, event);
+
+	return YELL_SUCCESS;
+}
+
+void *bench_send(void *node_ptr) {
+	struct bench_node *node = (struct bench_node *)node_ptr;
+	struct yell_peer **targets = NULL;
+	char name[NAME_SIZE + 1], *message;
+	unsigned int seed = node->index;
+	uint64_t stamp, nfailed = 0;
+	int ntargets = 0, i, n = 0;
+
+	message = (char *)malloc(options.size);
+
+	if (message == NULL) {
+		atomic_store(&shared->failed, 1);
+
+		return NULL;
+	}
+
+	// the payload shouldn't compress any better than real data would
+	for (i = 0; i < options.size; ++i)
+		message[i] = rand_r(&seed);
+
+	// unicasts go round every other node
+	if (options.workload == BW_UNICAST) {
+		targets = (struct yell_peer **)malloc(options.nodes * sizeof(struct yell_peer *));
+
+		if (targets == NULL) {
+			atomic_store(&shared->failed, 1);
+			free(message);
+
+			return NULL;
+		}
+
+		for (i = 0; i < options.nodes; ++i) {
+			if (i == node->index)
+				continue;
+
+			snprintf(name, sizeof(name), "bench%d", i);
+
+			if ((targets[ntargets] = yell_findpeer(&node->self, name)) != NULL)
+				++ntargets;
+		}
+	}
+
+	bench_min(&shared->start_ns, bench_now());
+
+	for (i = 0; i < options.messages; ++i) {
+		stamp = bench_now();
+		memcpy(message, &stamp, STAMP_SIZE);
+
+		switch (options.workload) {
+		case BW_BROADCAST:
+			n = yell_broadcast(&node->self, message, options.size, NULL, 0);
+
+			break;
+		case BW_UNICAST:
+			n = ntargets == 0
+			  || yell_topeer(&node->self, targets[i % ntargets], YET_MESSAGE, message, options.size, NULL) == YELL_FAILURE;
+
+			break;
+		case BW_GOSSIP:
+			n = yell_gossip(&node->self, message, options.size);
+
+			break;
+		case BW_QUEUE:
+			n = yell_queue(&node->self, message, options.size);
+
+			break;
+		case BW_DATAGRAM:
+			n = yell_datagram(&node->self, message, options.size);
+
+			break;
+		}
+
+		// -1 means not even one peer could be sent to
+		nfailed += n < 0 ? options.nodes - 1 : n;
+	}
+
+	if (options.workload == BW_QUEUE)
+		yell_flush(&node->self);
+
+	atomic_fetch_add(&shared->send_failures, nfailed);
+
+	free(targets);
+	free(message);
+
+	return NULL;
+}
+
+// the number of peers of the node that are alive
+int bench_npeers(struct yell *self) {
+	struct yell_stats stats;
+	int npeers, i;
+
+	if (yell_stats(self, &stats) == YELL_FAILURE)
+		return 0;
+
+	for (npeers = 0, i = 0; i < stats.npeers; ++i)
+		if (stats.peers[i].state == YPS_ALIVE)
+			++npeers;
+
+	yell_freestats(&stats);
+
+	return npeers;
+}
+
+// waits for the deliveries to finish, or to stop arriving for DRAIN_TIMEOUT
+void bench_drain(void) {
+	uint64_t expected = bench_expected(), delivered, last = 0, idle_since = bench_now();
+
+	while ((delivered = atomic_load(&shared->delivered)) < expected) {
+		if (delivered != last) {
+			last = delivered;
+			idle_since = bench_now();
+		} else if (bench_now() - idle_since > (uint64_t)DRAIN_TIMEOUT * 1000000) {
+			break;
+		}
+
+		usleep(1000);
+	}
+}
+
+/* Runs the nodes of one process: node i is hosted by process i % processes.
+ * Every process starts its nodes, meshes them by connecting to the first node, then sends from them at once. */
+int bench_run(int process) {
+	struct bench_node *nodes;
+	FILE *log;
+	char name[NAME_SIZE + 1];
+	uint64_t cpu, nallocs;
+	int nnodes, i, status = EXIT_FAILURE;
+
+	log = options.verbose ? stderr : fopen("/dev/null", "w");
+
+	nnodes = (options.nodes - process + options.processes - 1) / options.processes;
+	nodes = (struct bench_node *)calloc(nnodes, sizeof(struct bench_node));
+
+	if (log == NULL || nodes == NULL) {
+		fprintf(stderr, "bench: Memory allocation error.\n");
+		atomic_store(&shared->failed, 1);
+
+		return EXIT_FAILURE;
+	}
+
+	// the first node must be up before anyone can connect to it
+	if (process != 0) {
+		while (atomic_load(&shared->port) == 0 && !atomic_load(&shared->failed))
+			usleep(1000);
+	}
+
+	for (i = 0; i < nnodes; ++i) {
+		nodes[i].index = process + i * options.processes;
+		snprintf(name, sizeof(name), "bench%d", nodes[i].index);
+
+		if (yell_start(log, &nodes[i].self, name, event_handler) == YELL_FAILURE) {
+			fprintf(stderr, "bench: Couldn't start %s.\n", name);
+			atomic_store(&shared->failed, 1);
+
+			nnodes = i;
+
+			goto exit;
+		}
+
+		if (nodes[i].index == 0)
+			atomic_store(&shared->port, nodes[i].self.sockport);
+	}
+
+	if (bench_barrier(&shared->started, options.processes) < 0)
+		goto exit;
+
+	for (i = 0; i < nnodes; ++i) {
+		if (nodes[i].index != 0 && yell_connect(&nodes[i].self, "127.0.0.1", atomic_load(&shared->port)) == YELL_FAILURE) {
+			fprintf(stderr, "bench: Couldn't connect bench%d.\n", nodes[i].index);
+			atomic_store(&shared->failed, 1);
+
+			goto exit;
+		}
+	}
+
+	// every node must know every other before the clock starts
+	for (i = 0; i < nnodes; ++i) {
+		uint64_t deadline = bench_now() + (uint64_t)MESH_TIMEOUT * 1000000;
+
+		while (bench_npeers(&nodes[i].self) < options.nodes - 1) {
+			if (bench_now() > deadline) {
+				fprintf(stderr, "bench: bench%d only knows %d peers.\n", nodes[i].index, bench_npeers(&nodes[i].self));
+				atomic_store(&shared->failed, 1);
+
+				goto exit;
+			}
+
+			usleep(1000);
+		}
+	}
+
+	if (bench_barrier(&shared->meshed, options.processes) < 0)
+		goto exit;
+
+	cpu = bench_cpu();
+	nallocs = atomic_load(&allocs);
+
+	if (bench_barrier(&shared->armed, options.processes) < 0)
+		goto exit;
+
+	for (i = 0; i < nnodes; ++i)
+		if (nodes[i].index < options.senders)
+			pthread_create(&nodes[i].thread, NULL, bench_send, &nodes[i]);
+
+	for (i = 0; i < nnodes; ++i)
+		if (nodes[i].index < options.senders)
+			pthread_join(nodes[i].thread, NULL);
+
+	if (bench_barrier(&shared->sent, options.processes) < 0)
+		goto exit;
+
+	bench_drain();
+
+	atomic_fetch_add(&shared->cpu_us, bench_cpu() - cpu);
+	atomic_fetch_add(&shared->allocs, atomic_load(&allocs) - nallocs);
+
+	// no node may leave while another process is still counting deliveries
+	if (bench_barrier(&shared->finished, options.processes) < 0)
+		goto exit;
+
+	status = EXIT_SUCCESS;
+
+exit:
+	for (i = nnodes - 1; i >= 0; --i)
+		yell_exit(&nodes[i].self);
+
+	free(nodes);
+
+	if (log != stderr)
+		fclose(log);
+
+	return status;
+}
+
+void bench_report(void) {
+	uint64_t expected = bench_expected(),
+	         delivered = atomic_load(&shared->delivered),
+	         start = atomic_load(&shared->start_ns),
+	         end = atomic_load(&shared->end_ns);
+	double seconds = end > start ? (end - start) / 1e9 : 0;
+
+	// one line of JSON, so that runs can be collected and compared
+	printf("{\"workload\":\"%s\",\"nodes\":%d,\"processes\":%d,\"senders\":%d,\"messages\":%d,\"size\":%d,",
+	       bench_workloads[options.workload], options.nodes, options.processes, options.senders, options.messages, options.size);
+	printf("\"expected\":%" PRIu64 ",\"delivered\":%" PRIu64 ",\"send_failures\":%" PRIu64 ",\"seconds\":%.6f,",
+	       expected, delivered, atomic_load(&shared->send_failures), seconds);
+	printf("\"msgs_per_sec\":%.1f,\"mbytes_per_sec\":%.3f,",
+	       seconds > 0 ? delivered / seconds : 0, seconds > 0 ? delivered * options.size / seconds / 1e6 : 0);
+	printf("\"p50_us\":%" PRIu64 ",\"p99_us\":%" PRIu64 ",\"p999_us\":%" PRIu64 ",\"max_us\":%" PRIu64 ",",
+	       yell_HG_percentile(&shared->latency, 50), yell_HG_percentile(&shared->latency, 99),
+	       yell_HG_percentile(&shared->latency, 99.9), atomic_load(&shared->latency.max));
+	printf("\"cpu_us_per_msg\":%.3f,\"allocs_per_msg\":%.3f}\n",
+	       delivered > 0 ? (double)atomic_load(&shared->cpu_us) / delivered : 0,
+	       delivered > 0 ? (double)atomic_load(&shared->allocs) / delivered : 0);
+}
+
+void usage(const char *argv0) {
+	fprintf(stderr, "usage: %s [-w broadcast|unicast|gossip|queue|datagram] [-n nodes] [-p processes]\n"
+	                "       %*s [-s senders] [-m messages per sender] [-b message bytes] [-v]\n",
+	        argv0, (int)strlen(argv0), "");
+}
+
+int main(int argc, char **argv) {
+	pid_t pid;
+	int c, i, status, failed;
+
+	options.workload = BW_BROADCAST;
+	options.nodes = 4;
+	options.processes = 1;
+	options.senders = -1;
+	options.messages = 10000;
+	options.size = 64;
+	options.verbose = 0;
+
+	while ((c = getopt(argc, argv, "w:n:p:s:m:b:v")) != -1) {
+		switch (c) {
+		case 'w':
+			for (i = 0; i < (int)(sizeof(bench_workloads) / sizeof(*bench_workloads)); ++i)
+				if (strcmp(optarg, bench_workloads[i]) == 0)
+					break;
+
+			if (i == (int)(sizeof(bench_workloads) / sizeof(*bench_workloads))) {
+				usage(argv[0]);
+
+				return EXIT_FAILURE;
+			}
+
+			options.workload = i;
+
+			break;
+		case 'n':
+			options.nodes = atoi(optarg);
+
+			break;
+		case 'p':
+			options.processes = atoi(optarg);
+
+			break;
+		case 's':
+			options.senders = atoi(optarg);
+
+			break;
+		case 'm':
+			options.messages = atoi(optarg);
+
+			break;
+		case 'b':
+			options.size = atoi(optarg);
+
+			break;
+		case 'v':
+			options.verbose = 1;
+
+			break;
+		default:
+			usage(argv[0]);
+
+			return EXIT_FAILURE;
+		}
+	}
+
+	// every node sends by default
+	if (options.senders < 0 || options.senders > options.nodes)
+		options.senders = options.nodes;
+
+	if (options.nodes < 2 || options.nodes > MAX_NODES || options.processes < 1 || options.processes > options.nodes
+	 || options.messages < 1 || options.size < (int)STAMP_SIZE) {
+		usage(argv[0]);
+
+		return EXIT_FAILURE;
+	}
+
+	shared = (struct bench_shared *)mmap(NULL, sizeof(struct bench_shared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+	if (shared == MAP_FAILED) {
+		perror("bench: mmap()");
+
+		return EXIT_FAILURE;
+	}
+
+	memset(shared, 0, sizeof(struct bench_shared));
+	atomic_store(&shared->start_ns, UINT64_MAX);
+	yell_HG_init(&shared->latency);
+
+	// in one process, the nodes are run by this one
+	if (options.processes == 1) {
+		failed = bench_run(0) != EXIT_SUCCESS;
+	} else {
+		// flush before forking, so nothing buffered is printed twice
+		fflush(stdout);
+
+		for (i = 0; i < options.processes; ++i) {
+			pid = fork();
+
+			if (pid < 0) {
+				perror("bench: fork()");
+				atomic_store(&shared->failed, 1);
+
+				break;
+			}
+
+			if (pid == 0)
+				exit(bench_run(i));
+		}
+
+		failed = 0;
+
+		while (wait(&status) > 0)
+			if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+				failed = 1;
+	}
+
+	if (failed || atomic_load(&shared->failed)) {
+		fprintf(stderr, "bench: Failed.\n");
+
+		return EXIT_FAILURE;
+	}
+
+	bench_report();
+
+	return EXIT_SUCCESS;
+}
@@ -9,6 +9,9 @@
 #define PEERADDRF  "($a:$p) $n"
 
 int event_handler(struct yell *self, struct yell_event *event) {
+	// events from different peers are handled concurrently; keep each one's output together
+	flockfile(stdout);
+
 	// erase line and return to the beginning
 	printf("\33[2K\r");
 
@@ -28,7 +31,9 @@ int event_handler(struct yell *self, struct yell_event *event) {
 	yell_peerf(stdout, PEERADDRF "> ", self->name, self->sockaddr);
 	fflush(stdout);
 
-	free(event);
+	funlockfile(stdout);
+
+	yell_freeevent(self, event);
 
 	return YELL_SUCCESS;
 }
@@ -110,6 +115,13 @@ int main(void) {
 			continue;
 		}
 
+		// stats command
+		if (strcmp(line, "stats") == 0) {
+			yell_statsf(stdout, &self);
+
+			continue;
+		}
+
 		// yell command
 		if (strcmp(line, "yell") == 0) {
 			yell(&self, body);
@@ -1,12 +1,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
-#include <ctype.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/timerfd.h>
 
 #include "whisper.h"
 
-#define FRAMES_PER_SEC  (1.0 / 15.0)
+// frames are drawn on a tick of the frame timer, and only if something changed since the last one
+#define FRAME_RATE  15
 
 FILE *logfile;
 
@@ -23,219 +26,254 @@ void print_log(void) {
 	fclose(logfile);
 }
 
-int main(void) {
-	int game,
-	    ch,
-	    height, width,
-	    c, i, j,
-	    y_new, x_new;
-	clock_t last, current;
-	WINDOW *map_window;
-	yellself_t self;
-	event_t *event_v;
-	map_t map;
-	char msg[BUFFER_SIZE], buf[BUFFER_SIZE],
-	     name[NAME_SIZE], speaker[NAME_SIZE];
-	struct player_node *pnode;
-	player_t *node_player;
-	yellnode_t *node;
+// redraws what changed since the last frame, or everything after a prompt or a resize
+void draw_frame(map_t *map, struct yell *self) {
+	static int height = 0, width = 0;
+	int y;
 
-	// initialize yell
+	if (getmaxy(stdscr) != height || getmaxx(stdscr) != width)
+		map->redraw = 1;
 
-	atexit(print_log);
-	logfile = tmpfile();
+	if (map->redraw) {
+		height = getmaxy(stdscr);
+		width = getmaxx(stdscr);
 
-	fprintf(logfile, "Whisper started.\n");
+		clear();
 
-	// initialize ncurses
+		if (height <= MAP_H || width <= MAP_W) {
+			move(height / 2, (width / 2) - 13);
+			printw("Please resize the terminal.\n");
+			move((height / 2) + 1, (width / 2) - 20);
+			printw("It is not large enough to print the map.\n");
 
-	initscr();
-	cbreak();
-	keypad(stdscr, TRUE);
-	
-	if (has_colors() == FALSE) {
-		fprintf(stderr, "Terminal does not support colors.\n");
+			refresh();
 
-		exit(EXIT_FAILURE);
-	}
+			return;
+		}
 
-	echo();
-	nodelay(stdscr, FALSE);
+#ifdef DEBUG
+		move(0, 0);
+		printw("%d, %d\n", height, width);
+#endif
 
-	read_input(stdscr, name, "Choose a display name:");
+		move(height - 1,0);
+		printw("Listening on port %d. Unique node name is %s.\n", self->sockport, self->name);
 
-	// initialize yell
+		// the window only moves when the terminal is resized
+		if (map->window != NULL)
+			delwin(map->window);
 
-	yell_init(&self, name);
-	yell_debug(&self, logfile);
+		map->window = newwin(MAP_H, MAP_W, (height - MAP_H) / 2, (width - MAP_W) / 2);
+		box(map->window, 0, 0);
 
-	noecho();
-	nodelay(stdscr, TRUE);
+		for (y = 1; y < MAP_H - 1; ++y)
+			map->dirty[y] = 1;
 
-	//start_color();
-	//init_pair(1, COLOR_WHITE, COLOR_BLUE);
+		map->ndirty = MAP_H - 2;
+		map->redraw = 0;
+	}
 
-	player_create(&map.player, "O_O", NULL, 8, 8);
+	map_draw(map);
 
-	map.player_ll = NULL;
-	map.sprite_ll = NULL;
+	// only the lines of a window that changed are copied to the screen, and the map is copied last
+	wnoutrefresh(stdscr);
+	wnoutrefresh(map->window);
+	doupdate();
+}
 
-	game = true;
-	last = 0;
+// reads every key waiting on stdin; clears game on quit
+void handle_input(struct yell *self, map_t *map, int *game) {
+	char msg[BUFFER_SIZE], buf[BUFFER_SIZE];
+	int ch;
 
-	clear();
+	while ((ch = getch()) != ERR) {
+#ifdef DEBUG
+		move(1, 0);
+		addch(ch);
+#endif
 
-	// game loop
-	while (game) {
-		// parse yell events
-		for (; (event_v = yell_nextevent(&self)) != NULL; yell_freeevent(event_v)) {
-			i = 0;
+		switch (ch) {
+		case 'q':
+			*game = false;
 
-			if (event_v->event->buf[i] == '(') {
-				++i;
+			break;
+		case 'y':
+			echo();
+			nodelay(stdscr, FALSE);
 
-				for (j = 0; event_v->event->buf[i] != ')'; ++j, ++i) {
-					speaker[j] = event_v->event->buf[i];
-				}
+			read_input(stdscr, msg, "What will you yell?");
 
-				// skip the space that follows a name
-				i += 2;
+			sprintf(buf, "(%s) ", self->name);
+			strncat(buf, msg, BUFFER_SIZE - strlen(buf) - 1);
 
-				speaker[j] = '\0';
-			} else {
-				fprintf(logfile, "Strange packet received.\n");
+			yell(self, buf);
+			player_say(map, &map->player, buf);
 
-				continue;
-			}
+			noecho();
+			nodelay(stdscr, TRUE);
 
-			node = yell_node(&self, speaker);
+			// the prompt took over the screen
+			map_invalidate(map);
 
-			if (node == NULL) {
-				fprintf(logfile, "Invalid speaker: %s\n", speaker);
+			break;
+		case 'c':
+			echo();
+			nodelay(stdscr, FALSE);
 
-				continue;
-			}
+			add_peer(self, map, stdscr);
 
-			if (event_v->event->buf[i] == '(') {
-				++i;
+			noecho();
+			nodelay(stdscr, TRUE);
 
-				sscanf(&event_v->event->buf[i], "%d,%d", &y_new, &x_new);
+			map_invalidate(map);
 
-				node_player = player_node(&map, node);
-				player_move(node_player, y_new, x_new);
+			break;
+		case KEY_RESIZE:
+			map_invalidate(map);
 
-				continue;
-			}
+			break;
+		default:
+			// moves are sent on the next frame, together with any others made before it
+			player_ctrl(map, &map->player, ch);
 
-			strcpy(node->event.buf, event_v->event->buf);
-			node->event.type = event_v->event->type;
+			break;
 		}
+	}
+}
 
-		current = clock();
+int main(void) {
+	int game,
+	    timer_fd,
+	    frame;
+	struct itimerspec tick;
+	struct pollfd fds[4];
+	uint64_t expirations;
+	struct yell self;
+	struct yell_event *event;
+	struct yell_completion completion;
+	map_t map;
+	char name[BUFFER_SIZE];
 
-		if (FRAMES_PER_SEC > (double)(current - last) / CLOCKS_PER_SEC)
-			continue;
+	// initialize yell
 
-		last = current;
+	atexit(print_log);
+	logfile = tmpfile();
 
-		move(0, 0);
+	fprintf(logfile, "Whisper started.\n");
 
-		if (getmaxy(stdscr) != height || getmaxx(stdscr) != width)
-			clear();
+	// initialize ncurses
 
-		height = getmaxy(stdscr);
-		width = getmaxx(stdscr);
-#ifdef DEBUG
-		printw("%d, %d\n", height, width);
-#endif
+	initscr();
+	cbreak();
+	keypad(stdscr, TRUE);
 
-		delwin(map_window);
-		map_window = newwin(MAP_H, MAP_W, (height - MAP_H) / 2, (width - MAP_W) / 2);
-		box(map_window, 0, 0);
+	if (has_colors() == FALSE) {
+		endwin();
+		fprintf(stderr, "Terminal does not support colors.\n");
 
-		if (height <= MAP_H || width <= MAP_W) {
-			move(height / 2, (width / 2) - 13);
-			printw("Please resize the terminal.\n");
-			move((height / 2) + 1, (width / 2) - 20);
-			printw("It is not large enough to print the map.\n");
+		exit(EXIT_FAILURE);
+	}
 
-			// still check if the user wants to quit
-			while ((ch = getch()) != ERR)
-				if (ch == 'q')
-					game = false;
+	echo();
+	nodelay(stdscr, FALSE);
 
-			continue;
-		}
-		
-		// get user input
-		while ((ch = getch()) != ERR) {
-#ifdef DEBUG
-			move(1, 0);
-			addch(ch);
-#endif
+	read_input(stdscr, name, "Choose a display name:");
 
-			switch (ch) {
-			case 'q':
-				game = false;
+	// initialize yell
 
-				break;
-			case 'y':
-				echo();
-				nodelay(stdscr, FALSE);
+	if (yell_start(logfile, &self, name, NULL) == YELL_FAILURE) {
+		endwin();
+		fprintf(stderr, "Failure starting yell.\n");
 
-				read_input(stdscr, msg, "What will you yell?");
+		exit(EXIT_FAILURE);
+	}
 
-				sprintf(buf, "(%s) ", self.name);
-				strcat(buf, msg);
+	noecho();
+	nodelay(stdscr, TRUE);
 
-				yell(&self, buf);
-				strcpy(map.player.message, buf);
+	// the frame timer ticks FRAME_RATE times a second
+	timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
 
-				noecho();
-				nodelay(stdscr, TRUE);
+	tick.it_interval.tv_sec = 0;
+	tick.it_interval.tv_nsec = 1000000000 / FRAME_RATE;
+	tick.it_value = tick.it_interval;
 
-				break;
-			case 'c':
-				echo();
-				nodelay(stdscr, FALSE);
+	if (timer_fd < 0 || timerfd_settime(timer_fd, 0, &tick, NULL) < 0) {
+		yell_exit(&self);
+		endwin();
+		fprintf(stderr, "Failure starting the frame timer.\n");
 
-				add_peer(&self, &map, stdscr);
+		exit(EXIT_FAILURE);
+	}
 
-				noecho();
-				nodelay(stdscr, TRUE);
+	/* The game sleeps until a key is pressed, a node sends an event, a record sent to a node completes, or a frame is due.
+	 * Keys and events are handled as soon as they arrive; on the next frame, the other nodes are told of moves,
+	 * and the screen is redrawn. */
 
-				break;
-			default:
-				if (player_ctrl(&map.player, ch)) {
-					sprintf(buf, "(%s) (%d,%d)", self.name, map.player.sprite.y, map.player.sprite.x);
-					yell(&self, buf);
-				}
+	fds[0].fd = STDIN_FILENO;
+	fds[0].events = POLLIN;
+	fds[1].fd = yell_eventfd(&self);
+	fds[1].events = POLLIN;
+	fds[2].fd = timer_fd;
+	fds[2].events = POLLIN;
+	fds[3].fd = yell_completionfd(&self);
+	fds[3].events = POLLIN;
 
-				break;
-			}
-		}
+	//start_color();
+	//init_pair(1, COLOR_WHITE, COLOR_BLUE);
 
-		player_update(&map.player);
-		push_sprite(&map, &map.player.sprite);
+	if (map_init(&map) == YELL_HT_FAILURE) {
+		close(timer_fd);
+		yell_exit(&self);
+		endwin();
+		fprintf(stderr, "Failure creating the map.\n");
 
-		for (pnode = map.player_ll; pnode != NULL; pnode = pnode->next) {
-			player_update(pnode->player);
-			push_sprite(&map, &pnode->player->sprite);
-		}
+		exit(EXIT_FAILURE);
+	}
 
-		print_sprites(map_window, &map);
+	player_create(&map.player, "O_O", NULL, 8, 8);
+	push_player(&map, &map.player);
 
-		move(height - 1,0);
-		printw("Listening on port %d. Unique node name is %s.\n", self.port, self.name);
+	game = true;
+	frame = 0;
+
+	clear();
+
+	// game loop
+	while (game) {
+		// a resize interrupts the poll, after which getch() returns KEY_RESIZE
+		if (poll(fds, 4, -1) < 0 && errno != EINTR)
+			break;
+
+		// get user input
+		handle_input(&self, &map, &game);
+
+		// parse yell events
+		for (; (event = yell_nextevent(&self)) != NULL; yell_freeevent(&self, event))
+			handle_event(&map, event);
+
+		while (yell_nextcompletion(&self, &completion) == YELL_SUCCESS)
+			handle_completion(&map, &completion);
+
+		if (!(fds[2].revents & POLLIN))
+			continue;
 
-		wrefresh(map_window);
-		refresh();
+		// frames missed while a prompt was open are skipped
+		read(timer_fd, &expirations, sizeof(expirations));
 
-		empty_sprites(&map);
+		sync_players(&self, &map, ++frame % FAR_FRAMES == 0);
+
+		if (map_changed(&map))
+			draw_frame(&map, &self);
 	}
 
+	close(timer_fd);
+
 	yell_exit(&self);
 
+	map_free(&map);
+	free(map.player.sprite.art);
+
 	clear();
 	endwin();
 
@@ -1,6 +1,8 @@
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdint.h>
 
 #include "whisper.h"
 
@@ -62,19 +64,15 @@ void display_message(WINDOW *window, char *message) {
 	getch();
 }
 
-void add_peer(yellself_t *self, map_t *map, WINDOW *window) {
-	char addr[256], port[256];
-	yellnode_t *node;
-	player_t *player;
+void add_peer(struct yell *self, map_t *map, WINDOW *window) {
+	char addr[BUFFER_SIZE], port[BUFFER_SIZE];
 
 	read_input(window, addr, "Domain of node (e.g., 127.0.0.1):");
 	read_input(window, port, "Port of node (e.g., 5001):");
 
 	fprintf(logfile, "Attempted connection with %s:%s\n", addr, port);
 
-	node = yell_add(self, addr, atoi(port));
-
-	if (node == NULL) {
+	if (yell_connect(self, addr, atoi(port)) == YELL_FAILURE) {
 		display_message(window, "Couldn't connect to node.");
 
 		return;
@@ -82,188 +80,558 @@ void add_peer(yellself_t *self, map_t *map, WINDOW *window) {
 
 	display_message(window, "Succesfully connected.");
 
-	player = (player_t *)malloc(sizeof(player_t));
-	player_create(player, "x~x", node, rand() % MAP_H, rand() % MAP_W);
-	push_player(map, player);
+	// the other nodes meet the player when it first says where it is
+	send_hello(self, map);
+}
+
+// tells every node where the player is, without waiting for them; the nodes that already know it ignore this
+void send_hello(struct yell *self, map_t *map) {
+	char record[STATE_SIZE];
+	int len;
+
+	record[0] = STATE_HELLO;
+	len = 1;
+	len += put_varint(record + len, map->player.sprite.y);
+	len += put_varint(record + len, map->player.sprite.x);
+
+	yell_submit(self, NULL, record, len, NULL, NULL);
+}
+
+/* Called on every frame. The radius is one larger than the view,
+ * so that the players which a step took out of view see it leave. */
+void sync_players(struct yell *self, map_t *map, int everyone) {
+	player_t *near[NEAR_MAX], *player;
+	int n, y, x;
+
+	if (!everyone) {
+		n = map_near(map, map->player.sprite.y, map->player.sprite.x, VIEW_RADIUS + 1, near, NEAR_MAX);
+
+		// there may be more players near than were found
+		if (n < NEAR_MAX) {
+			while (n-- > 0)
+				sync_player(self, map, near[n]);
+
+			return;
+		}
+	}
+
+	for (y = 0; y < MAP_H; ++y)
+		for (x = 0; x < GRID_W; ++x)
+			for (player = map->grid[y][x]; player != NULL; player = player->next)
+				sync_player(self, map, player);
 }
 
-void push_sprite(map_t *map, sprite_t *sprite) {
-	struct sprite_node *new_node, *node;
+// sends the node of the player where this player is, unless it knows already or is still being told
+void sync_player(struct yell *self, map_t *map, player_t *player) {
+	char record[STATE_SIZE];
+	int y, x, len;
 
-	if (map->sprite_ll == NULL) {
-		map->sprite_ll = malloc(sizeof(struct sprite_node));
+	y = map->player.sprite.y;
+	x = map->player.sprite.x;
 
-		map->sprite_ll->sprite = sprite;
-		map->sprite_ll->next = NULL;
+	if (player->node == NULL || player->inflight)
+		return;
 
+	if (player->synced && player->acked_y == y && player->acked_x == x)
 		return;
+
+	// however many steps were taken since the last frame, they are sent as one
+	if (player->synced) {
+		record[0] = STATE_DELTA;
+		len = 1;
+		len += put_varint(record + len, y - player->acked_y);
+		len += put_varint(record + len, x - player->acked_x);
+	} else {
+		record[0] = STATE_KEYFRAME;
+		len = 1;
+		len += put_varint(record + len, y);
+		len += put_varint(record + len, x);
 	}
 
-	new_node = malloc(sizeof(struct sprite_node));
-	new_node->sprite = sprite;
+	if (yell_submit(self, player->node, record, len, NULL, NULL) == YELL_FAILURE)
+		return;
+
+	player->inflight = 1;
+	player->sent_y = y;
+	player->sent_x = x;
+}
+
+/* A record that failed may still have arrived, so the node is sent a keyframe next.
+ * Hellos are sent to every node, and their completions are ignored. */
+void handle_completion(map_t *map, struct yell_completion *completion) {
+	player_t *player;
+
+	if (completion->peer == NULL || (player = player_node(map, completion->peer)) == NULL)
+		return;
+
+	player->inflight = 0;
+	player->synced = completion->status == YELL_SUCCESS;
+
+	if (!player->synced)
+		return;
+
+	player->acked_y = player->sent_y;
+	player->acked_x = player->sent_x;
+}
+
+void handle_event(map_t *map, struct yell_event *event) {
+	char speaker[NAME_SIZE + 1];
+	player_t *player;
+	int y, x, len,
+	    i, j;
+
+	player = player_node(map, event->peer);
+
+	// a node that left takes its player with it
+	if (event->type == YET_DISCONNECT) {
+		if (player == NULL)
+			return;
+
+		remove_player(map, player);
 
-	if (sprite->y < map->sprite_ll->sprite->y) {
-		new_node->next = map->sprite_ll;
-		map->sprite_ll = new_node;
+		free(player->sprite.art);
+		free(player);
 
 		return;
 	}
 
-	for (node = map->sprite_ll; node->next != NULL; node = node->next) {
-		if (sprite->y >= node->sprite->y && sprite->y < node->next->sprite->y) {
-			new_node->next = node->next;
-			node->next = new_node;
+	if (event->type != YET_MESSAGE || event->length == 0)
+		return;
+
+	if (event->packet[0] == STATE_HELLO || event->packet[0] == STATE_KEYFRAME || event->packet[0] == STATE_DELTA) {
+		// a node is met when it first says where it is, and is told where this player is on the next frame
+		if (player == NULL && event->packet[0] != STATE_DELTA) {
+			len = get_varint(event->packet + 1, event->length - 1, &y);
+
+			if (len == 0 || get_varint(event->packet + 1 + len, event->length - 1 - len, &x) == 0) {
+				fprintf(logfile, "Strange packet received.\n");
+
+				return;
+			}
+
+			player = (player_t *)malloc(sizeof(player_t));
+
+			// memory allocation error
+			if (player == NULL)
+				return;
+
+			player_create(player, "x~x", event->peer, y, x);
+
+			if (push_player(map, player) == YELL_HT_FAILURE) {
+				free(player->sprite.art);
+				free(player);
+			}
+
+			return;
+		}
+
+		if (player == NULL) {
+			fprintf(logfile, "Position received from a node that wasn't met.\n");
 
 			return;
 		}
+
+		handle_state(map, player, event);
+
+		return;
+	}
+
+	i = 0;
+
+	if (event->packet[i] == '(') {
+		++i;
+
+		for (j = 0; event->packet[i] != ')' && event->packet[i] != '\0' && j < NAME_SIZE; ++j, ++i) {
+			speaker[j] = event->packet[i];
+		}
+
+		speaker[j] = '\0';
+	} else {
+		fprintf(logfile, "Strange packet received.\n");
+
+		return;
+	}
+
+	if (strcmp(speaker, event->peer->name) != 0) {
+		fprintf(logfile, "Invalid speaker: %s\n", speaker);
+
+		return;
+	}
+
+	if (player == NULL) {
+		fprintf(logfile, "Message received from a node that wasn't met.\n");
+
+		return;
 	}
 
-	new_node->next = NULL;
-	node->next = new_node;
+	player_say(map, player, event->packet);
 }
 
-void print_sprites(WINDOW *window, map_t *map) {
-	struct sprite_node *node;
-	int y, x,
-	    i,
-	    y_start, x_start;
+// moves a player that was already met to the position in a record
+void handle_state(map_t *map, player_t *player, struct yell_event *event) {
+	int y, x, len;
 
-	for (node = map->sprite_ll; node != NULL; node = node->next) {
-		for (i = 0, y = 0;; ++y) {
-			y_start = node->sprite->y - node->sprite->y_shift + y;
-			x_start = node->sprite->x - node->sprite->x_shift;
+	// the player is already where the hello would put it
+	if (event->packet[0] == STATE_HELLO)
+		return;
 
-			if (y_start < 0 || y_start >= getmaxy(window)) {
-				while (node->sprite->art[i] != '\n'
-				    && node->sprite->art[i] != '\0')
-					++i;
+	len = get_varint(event->packet + 1, event->length - 1, &y);
 
-				if (node->sprite->art[i] == '\0')
-					break;
+	if (len == 0 || get_varint(event->packet + 1 + len, event->length - 1 - len, &x) == 0) {
+		fprintf(logfile, "Strange packet received.\n");
 
-				++i;
+		return;
+	}
 
-				continue;
-			}
+	if (event->packet[0] == STATE_DELTA) {
+		y += player->sprite.y;
+		x += player->sprite.x;
+	}
+
+	player_move(map, player, y, x);
+}
+
+// writes the value as a zigzag varint, so that small negative numbers are short too; returns its length
+int put_varint(char *buf, int value) {
+	unsigned int zigzag;
+	int len;
+
+	zigzag = ((unsigned int)value << 1) ^ (value < 0 ? ~0U : 0U);
+
+	for (len = 0; zigzag >= 0x80; ++len, zigzag >>= 7)
+		buf[len] = (char)(zigzag | 0x80);
+
+	buf[len++] = (char)zigzag;
+
+	return len;
+}
+
+// reads a zigzag varint; returns its length, or 0 if it runs past length or is too long
+int get_varint(const char *buf, size_t length, int *value) {
+	unsigned int zigzag;
+	size_t i;
+
+	for (zigzag = 0, i = 0; i < length && i < 5; ++i) {
+		zigzag |= (unsigned int)(buf[i] & 0x7F) << (7 * i);
+
+		if ((buf[i] & 0x80) == 0) {
+			*value = (int)(zigzag >> 1) ^ -(int)(zigzag & 1);
+
+			return i + 1;
+		}
+	}
+
+	return 0;
+}
+
+int map_init(map_t *map) {
+	map->window = NULL;
+	map->ndirty = 0;
+	map->redraw = 1;
+
+	memset(map->dirty, 0, sizeof(map->dirty));
+	memset(map->grid, 0, sizeof(map->grid));
+
+	return yell_HT_init(&map->players, player_key, player_hash, player_match);
+}
+
+// frees every other player; this player is part of the map
+void map_free(map_t *map) {
+	player_t *player, *next;
+	int y, x;
 
-			wmove(window, y_start, x_start >= 0 ? x_start : 0);
+	for (y = 0; y < MAP_H; ++y) {
+		for (x = 0; x < GRID_W; ++x) {
+			for (player = map->grid[y][x]; player != NULL; player = next) {
+				next = player->next;
 
-			for (x = 0; node->sprite->art[i] != '\n'
-			         && node->sprite->art[i] != '\0'; ++i, ++x) {
-				if (x_start + x < 0 || x_start + x >= getmaxx(window))
+				if (player == &map->player)
 					continue;
 
-				waddch(window, node->sprite->art[i]);
+				free(player->sprite.art);
+				free(player);
 			}
 
-			// skip the new-line character
-			++i;
+			map->grid[y][x] = NULL;
+		}
+	}
+
+	yell_HT_free(&map->players);
+}
+
+// the cell holding the spot; players off the map are kept in the cells along its edge
+player_t **map_cell(map_t *map, int y, int x) {
+	y = y < 0 ? 0 : y < MAP_H ? y : MAP_H - 1;
+	x = x < 0 ? 0 : x < MAP_W ? x : MAP_W - 1;
+
+	return &map->grid[y][x / CELL_W];
+}
+
+/* Finds up to max players within radius rows and twice as many columns of the spot,
+ * since a character is about twice as tall as it is wide; returns how many were found. */
+int map_near(map_t *map, int y, int x, int radius, player_t **near, int max) {
+	player_t *player;
+	int top, bottom, left, right,
+	    row, cell, n;
+
+	top = y - radius < 0 ? 0 : y - radius;
+	bottom = y + radius < MAP_H ? y + radius : MAP_H - 1;
+	left = x - radius * 2 < 0 ? 0 : (x - radius * 2) / CELL_W;
+	right = x + radius * 2 < MAP_W ? (x + radius * 2) / CELL_W : GRID_W - 1;
+
+	n = 0;
+
+	for (row = top; row <= bottom; ++row) {
+		for (cell = left; cell <= right; ++cell) {
+			for (player = map->grid[row][cell]; player != NULL; player = player->next) {
+				if (abs(player->sprite.y - y) > radius || abs(player->sprite.x - x) > radius * 2)
+					continue;
+
+				if (n == max)
+					return n;
+
+				near[n++] = player;
+			}
 		}
 	}
+
+	return n;
+}
+
+// marks the rows inside the border that the sprite covers
+void map_touch(map_t *map, sprite_t *sprite) {
+	int top, y;
+
+	top = sprite->y - sprite->y_shift;
+
+	for (y = top > 1 ? top : 1; y < top + sprite->h && y < MAP_H - 1; ++y) {
+		if (map->dirty[y])
+			continue;
+
+		map->dirty[y] = 1;
+		++map->ndirty;
+	}
+}
+
+void map_invalidate(map_t *map) {
+	map->redraw = 1;
+}
+
+int map_changed(map_t *map) {
+	return map->redraw || map->ndirty > 0;
 }
 
-void empty_sprites(map_t *map) {
-	struct sprite_node *node, *next;
+// redraws the dirty rows of the window; sprites lower on the map are drawn over those above them
+void map_draw(map_t *map) {
+	player_t *player;
+	int y, y_sprite, x;
+
+	for (y = 1; y < MAP_H - 1; ++y) {
+		if (!map->dirty[y])
+			continue;
+
+		mvwhline(map->window, y, 1, ' ', MAP_W - 2);
+
+		// a sprite covers the row if its feet are on it or the rows below it
+		for (y_sprite = y; y_sprite < y + SPRITE_H; ++y_sprite) {
+			// the cells of the last row also hold the players below the map
+			if (y_sprite >= MAP_H)
+				break;
+
+			for (x = 0; x < GRID_W; ++x)
+				for (player = map->grid[y_sprite][x]; player != NULL; player = player->next)
+					if (player->sprite.y == y_sprite)
+						draw_line(map->window, &player->sprite, y);
+		}
 
-	for (node = map->sprite_ll; node != NULL; node = next) {
-		next = node->next;
-		free(node);
+		map->dirty[y] = 0;
 	}
 
-	map->sprite_ll = NULL;
+	map->ndirty = 0;
+}
+
+// draws the line of the sprite that is on row y of the window, inside the border
+void draw_line(WINDOW *window, sprite_t *sprite, int y) {
+	int line, x_start, start, end;
+
+	line = y - (sprite->y - sprite->y_shift);
+	x_start = sprite->x - sprite->x_shift;
+
+	start = x_start < 1 ? 1 - x_start : 0;
+	end = sprite->len[line];
+
+	if (x_start + end > MAP_W - 1)
+		end = MAP_W - 1 - x_start;
+
+	if (start >= end)
+		return;
+
+	mvwaddnstr(window, y, x_start + start, sprite->art + sprite->line[line] + start, end - start);
 }
 
-void player_create(player_t *player, char face[4], yellnode_t *node, int y, int x) {
+void player_create(player_t *player, char face[4], struct yell_peer *node, int y, int x) {
 	strcpy(player->face, face);
 	player->sprite.art = (char *)malloc(sizeof(char) * ART_SIZE);
 	player->sprite.y = y;
 	player->sprite.x = x;
 	player->sprite.y_shift = 2;
 	player->sprite.x_shift = 1;
+	player->sprite.h = SPRITE_H;
 	player->node = node;
 	player->message[0] = '\0';
+	player->cell = NULL;
+	player->prev = NULL;
+	player->next = NULL;
+	player->synced = 0;
+	player->inflight = 0;
+
+	player_update(player);
 }
 
-int player_ctrl(player_t *player, int ch) {
+int player_ctrl(map_t *map, player_t *player, int ch) {
 	int dy, dx;
 
 	dy = (ch == KEY_DOWN) - (ch == KEY_UP);
 	dx = (ch == KEY_RIGHT) - (ch == KEY_LEFT);
 
-	player->sprite.y += dy;
-	player->sprite.x += dx;
+	if (dy == 0 && dx == 0)
+		return 0;
+
+	player_move(map, player, player->sprite.y + dy, player->sprite.x + dx);
 
-	return dy != 0 || dx != 0;
+	return 1;
 }
 
-void player_move(player_t *player, int y, int x) {
+void player_move(map_t *map, player_t *player, int y, int x) {
+	player_t **cell;
+
+	if (player->sprite.y == y && player->sprite.x == x)
+		return;
+
+	map_touch(map, &player->sprite);
+
 	player->sprite.y = y;
 	player->sprite.x = x;
+
+	map_touch(map, &player->sprite);
+
+	// a player on the map moves to the cell under its feet
+	cell = map_cell(map, y, x);
+
+	if (player->cell == NULL || player->cell == cell)
+		return;
+
+	unlink_player(player);
+	link_player(player, cell);
+}
+
+void player_say(map_t *map, player_t *player, const char *message) {
+	snprintf(player->message, sizeof(player->message), "%s", message);
+
+	// the speech may have been longer or shorter, so the rows are dirty either way
+	player_update(player);
+	map_touch(map, &player->sprite);
 }
 
+// rebuilds the art of the player, which only changes when it speaks
 void player_update(player_t *player) {
-	static const char *default_art = "\n/|\\\n/ \\";
-	
-	bzero(player->sprite.art, ART_SIZE);
-	strcpy(player->sprite.art, player->face);
-	strcat(player->sprite.art, " ");
+	static const char *body[SPRITE_H - 1] = { "/|\\", "/ \\" };
+	char *art = player->sprite.art;
+	int len, i;
 
-	if (player->node != NULL)
-		strcat(player->sprite.art, player->node->event.buf);
-	else
-		strcat(player->sprite.art, player->message);
+	// speech is one line; anything that isn't printable would throw the art out of place
+	len = snprintf(art, ART_SIZE, "%s %s", player->face, player->message);
+
+	// leave room for the body
+	if (len > ART_SIZE - 9)
+		len = ART_SIZE - 9;
+
+	for (i = 0; i < len; ++i)
+		if (!isprint((unsigned char)art[i]))
+			art[i] = ' ';
+
+	player->sprite.line[0] = 0;
+	player->sprite.len[0] = len;
 
-	strcat(player->sprite.art, default_art);
+	for (i = 1; i < SPRITE_H; ++i) {
+		art[len++] = '\n';
+
+		player->sprite.line[i] = len;
+		player->sprite.len[i] = strlen(body[i - 1]);
+
+		strcpy(art + len, body[i - 1]);
+		len += player->sprite.len[i];
+	}
 }
 
-player_t *player_node(map_t *map, yellnode_t *yellnode) {
-	struct player_node *node;
+player_t *player_node(map_t *map, struct yell_peer *node) {
+	return (player_t *)yell_HT_find(&map->players, node);
+}
+
+// players are indexed by the address of their node
+const void *player_key(const void *player) {
+	return ((const player_t *)player)->node;
+}
 
-	for (node = map->player_ll; node != NULL; node = node->next)
-		if (node->player->node == yellnode)
-			return node->player;
+size_t player_hash(const void *node) {
+	uint64_t hash = (uintptr_t)node;
 
-	return NULL;
+	hash *= 0x9E3779B97F4A7C15ULL;
+
+	return (size_t)(hash ^ hash >> 29);
 }
 
-void push_player(map_t *map, player_t *player) {
-	struct player_node *node;
+int player_match(const void *node, const void *other) {
+	return node == other;
+}
 
-	if (map->player_ll == NULL) {
-		map->player_ll = (struct player_node *)malloc(sizeof(struct player_node));
-		map->player_ll->player = player;
-		map->player_ll->next = NULL;
-	}
+// puts the player on the map; only the other players are indexed by node
+int push_player(map_t *map, player_t *player) {
+	if (player->node != NULL && yell_HT_insert(&map->players, player, NULL) == YELL_HT_FAILURE)
+		return YELL_HT_FAILURE;
 
-	for (node = map->player_ll; node->next != NULL; node = node->next)
-		;
+	link_player(player, map_cell(map, player->sprite.y, player->sprite.x));
+	map_touch(map, &player->sprite);
 
-	node->next = (struct player_node *)malloc(sizeof(struct player_node));
-	node = node->next;
-	node->player = player;
-	node->next = NULL;
+	return YELL_HT_SUCCESS;
 }
 
 void remove_player(map_t *map, player_t *player) {
-	struct player_node *node, *cut;
+	if (player->cell == NULL)
+		return;
+
+	map_touch(map, &player->sprite);
+	unlink_player(player);
 
-	if (map->player_ll->player == player) {
-		node = map->player_ll;
-		map->player_ll = node->next;
+	if (player->node != NULL)
+		yell_HT_remove(&map->players, player->node);
 
-		free(node);
+	// a player put back on the map is met again, and its node is sent a keyframe
+	player->synced = 0;
+	player->inflight = 0;
+}
 
-		return;
-	}
+void link_player(player_t *player, player_t **cell) {
+	player->cell = cell;
+	player->prev = NULL;
+	player->next = *cell;
 
-	for (node = map->player_ll; node->next != NULL; node = node->next) {
-		if (node->next->player == player) {
-			cut = node->next;
-			node->next = cut->next;
+	if (*cell != NULL)
+		(*cell)->prev = player;
 
-			free(cut);
+	*cell = player;
+}
 
-			break;
-		}
-	}
+void unlink_player(player_t *player) {
+	if (player->prev != NULL)
+		player->prev->next = player->next;
+	else
+		*player->cell = player->next;
+
+	if (player->next != NULL)
+		player->next->prev = player->prev;
+
+	player->cell = NULL;
+	player->prev = NULL;
+	player->next = NULL;
 }
@@ -8,12 +8,40 @@
 
 #include <ncurses.h>
 #include <yell.h>
+#include <yell_HT.h>
 
 #define ART_SIZE  256
 
 #define MAP_H  32
 #define MAP_W  64
 
+// every sprite is a line of speech above two lines of body
+#define SPRITE_H  3
+
+// the grid has a row of cells for each row of the map, and each cell is CELL_W columns wide
+#define CELL_W  8
+#define GRID_W  (MAP_W / CELL_W)
+
+/* On every frame, the players within VIEW_RADIUS rows, and twice as many columns, of this one are told where it is
+ * if it moved since they were last told; the players farther away are only told every FAR_FRAMES frames. */
+#define VIEW_RADIUS  8
+#define FAR_FRAMES   15
+
+// the most players found near this one at once; in a larger crowd, every player is told on every frame
+#define NEAR_MAX  256
+
+/* Positions are sent as binary records: a type, then two zigzag varints, y before x.
+ * A node is met with a hello, which is ignored by the nodes that already know it;
+ * after that it is sent a keyframe, then deltas from the last position that it acknowledged. */
+#define STATE_HELLO     0x01
+#define STATE_KEYFRAME  0x02
+#define STATE_DELTA     0x03
+
+#define STATE_SIZE  (1 + 2 * 5)
+
+// lines of text typed in by the player
+#define BUFFER_SIZE  1024
+
 #define DEBUG
 
 extern FILE *logfile;
@@ -23,42 +51,81 @@ typedef struct sprite {
 	int y, x,
 	    y_shift, x_shift,
 	    h;
+
+	// where each line starts in art, and how long it is; art is only rebuilt when it changes
+	int line[SPRITE_H], len[SPRITE_H];
 } sprite_t;
 
 typedef struct player {
 	sprite_t sprite;
-	yellnode_t *node;
-	char face[4], message[1024];
+	struct yell_peer *node;
+	char face[4], message[PACKET_SIZE];
+
+	// the cell of the grid that the feet of the player are in, and its neighbours there
+	struct player **cell, *prev, *next;
+
+	/* What the node of the player knows about where this player is. At most one record is sent to it at once;
+	 * until a keyframe is acknowledged, it is not synced, and a failed record makes it send another. */
+	int synced, inflight,
+	    acked_y, acked_x,
+	    sent_y, sent_x;
 } player_t;
 
 typedef struct map {
 	player_t player;
-	struct player_node {
-		player_t *player;
-		struct player_node *next;
-	} *player_ll;
-	struct sprite_node {
-		sprite_t *sprite;
-		struct sprite_node *next;
-	} *sprite_ll;
+
+	/* Every player, including this one, is in the cell of the grid under its feet,
+	 * so the players on a row, or near a spot, are found without looking at the rest.
+	 * The other players are also found by their node. */
+	player_t *grid[MAP_H][GRID_W];
+	struct yell_HT players;
+
+	/* The window is kept between frames, and only its rows that changed are redrawn.
+	 * A sprite marks the rows it covers as dirty before and after it moves or speaks;
+	 * the whole screen is redrawn after a prompt or a resize. */
+	WINDOW *window;
+	char dirty[MAP_H];
+	int ndirty, redraw;
 } map_t;
 
 void read_input(WINDOW *window, char *dst, char *description);
 void display_message(WINDOW *window, char *message);
 
-void add_peer(yellself_t *self, map_t *map, WINDOW *window);
+void add_peer(struct yell *self, map_t *map, WINDOW *window);
+void send_hello(struct yell *self, map_t *map);
+void sync_players(struct yell *self, map_t *map, int everyone);
+void sync_player(struct yell *self, map_t *map, player_t *player);
+void handle_completion(map_t *map, struct yell_completion *completion);
+void handle_event(map_t *map, struct yell_event *event);
+void handle_state(map_t *map, player_t *player, struct yell_event *event);
+
+int put_varint(char *buf, int value);
+int get_varint(const char *buf, size_t length, int *value);
 
-void push_sprite(map_t *map, sprite_t *sprite);
-void print_sprites(WINDOW *window, map_t *map);
-void empty_sprites(map_t *map);
+int map_init(map_t *map);
+void map_free(map_t *map);
+player_t **map_cell(map_t *map, int y, int x);
+int map_near(map_t *map, int y, int x, int radius, player_t **near, int max);
+void map_touch(map_t *map, sprite_t *sprite);
+void map_invalidate(map_t *map);
+int map_changed(map_t *map);
+void map_draw(map_t *map);
+void draw_line(WINDOW *window, sprite_t *sprite, int y);
 
-void player_create(player_t *player, char face[4], yellnode_t *node, int y, int x);
-int player_ctrl(player_t *player, int ch);
-void player_move(player_t *player, int y, int x);
+void player_create(player_t *player, char face[4], struct yell_peer *node, int y, int x);
+int player_ctrl(map_t *map, player_t *player, int ch);
+void player_move(map_t *map, player_t *player, int y, int x);
+void player_say(map_t *map, player_t *player, const char *message);
 void player_update(player_t *player);
-player_t *player_node(map_t *map, yellnode_t *node);
+player_t *player_node(map_t *map, struct yell_peer *node);
+
+const void *player_key(const void *player);
+size_t player_hash(const void *node);
+int player_match(const void *node, const void *other);
 
-void push_player(map_t *map, player_t *player);
+int push_player(map_t *map, player_t *player);
 void remove_player(map_t *map, player_t *player);
+void link_player(player_t *player, player_t **cell);
+void unlink_player(player_t *player);
 
 #endif
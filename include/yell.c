@@ -1,79 +1,240 @@
+// recvmmsg() and sendmmsg() are GNU extensions
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <string.h>
-#include <ctype.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdarg.h>
 
 #include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
 
 #include "yell.h"
 
+// not every platform has MSG_NOSIGNAL; SO_NOSIGPIPE is used there instead
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL  0
+#endif
+
+struct yell_peer *yell_createpeer(struct yell *self, const char *name, struct sockaddr_in sockaddr, int sockport) {
+	const char *fname = "yell_createpeer()";
+
+	struct yell_peer *peer;
+
+	peer = (struct yell_peer *)yell_MP_alloc(&self->peer_pool);
+
+	// memory allocation error
+	if (peer == NULL) {
+		yell_log(self, YELL_LOG_ERROR, "%s: Memory allocation error.\n", fname);
+
+		return NULL;
+	}
+
+	strncpy(peer->name, name, NAME_SIZE);
+	peer->name[NAME_SIZE] = '\0';
+
+	peer->sockaddr = sockaddr;
+	peer->sockaddr.sin_port = htons(sockport);
+	peer->sockport = sockport;
+
+	// no connection is opened until the first message
+	peer->sockfd = -1;
+	peer->last_used = 0;
+	peer->inlen = 0;
+	pthread_mutex_init(&peer->mutex, NULL);
+
+	peer->queue = peer->buffers[0];
+	peer->batch = peer->buffers[1];
+	peer->queuelen = 0;
+	peer->queuecount = 0;
+	pthread_mutex_init(&peer->queue_mutex, NULL);
+
+	// frames aren't compressed until the peer says it accepts them
+	atomic_init(&peer->lz, 0);
+
+	atomic_init(&peer->state, YPS_ALIVE);
+	peer->incarnation = 0;
+	atomic_init(&peer->acked, 0);
+
+	memset(&peer->counters, 0, sizeof(peer->counters));
+	peer->connected = 0;
+	atomic_init(&peer->rtt_count, 0);
+	atomic_init(&peer->rtt_sum, 0);
+	atomic_init(&peer->rtt_max, 0);
+
+	atomic_init(&peer->refs, 0);
+
+	return peer;
+}
+
+void yell_freepeer(struct yell *self, struct yell_peer *peer) {
+	yell_closepeer(peer);
+	pthread_mutex_destroy(&peer->mutex);
+	pthread_mutex_destroy(&peer->queue_mutex);
+
+	yell_MP_release(&self->peer_pool, peer);
+}
+
+// a peer that is held isn't freed once it has been removed
+void yell_holdpeer(struct yell_peer *peer) {
+	atomic_fetch_add(&peer->refs, 1);
+}
+
+void yell_releasepeer(struct yell_peer *peer) {
+	atomic_fetch_sub(&peer->refs, 1);
+}
+
+// keys of the peer indexes
+const void *yell_peername(const void *peer) {
+	return ((const struct yell_peer *)peer)->name;
+}
+
+const void *yell_peeraddr(const void *peer) {
+	return &((const struct yell_peer *)peer)->sockaddr;
+}
+
+size_t yell_addrhash(const void *sockaddr) {
+	const struct sockaddr_in *addr = (const struct sockaddr_in *)sockaddr;
+	size_t hash;
+
+	hash = (size_t)addr->sin_addr.s_addr << 16 ^ addr->sin_port;
+
+	// mix the bits, so that consecutive ports don't probe into each other
+	hash *= (size_t)0x9E3779B97F4A7C15ULL;
+
+	return hash ^ hash >> 29;
+}
+
+int yell_addrmatch(const void *sockaddr, const void *other) {
+	const struct sockaddr_in *a = (const struct sockaddr_in *)sockaddr,
+	                         *b = (const struct sockaddr_in *)other;
+
+	return a->sin_addr.s_addr == b->sin_addr.s_addr && a->sin_port == b->sin_port;
+}
+
+int yell_namematch(const void *name, const void *other) {
+	return strcmp((const char *)name, (const char *)other) == 0;
+}
+
 struct yell_peer *yell_findpeer(struct yell *self, const char *name) {
-	struct yell_LL_node *march;
 	struct yell_peer *peer;
 
 	pthread_mutex_lock(&self->peers_mutex);
 
-	for (march = self->peers.head; march != NULL; march = march->next) {
-		peer = (struct yell_peer *)march->data;
+	peer = (struct yell_peer *)yell_HT_find(&self->peers_byname, name);
 
-		// found peer
-		if (strcmp(peer->name, name) == 0) {
-			pthread_mutex_unlock(&self->peers_mutex);
+	pthread_mutex_unlock(&self->peers_mutex);
 
-			return peer;
-		}
-	}
+	return peer;
+}
+
+// sockaddr must hold the port of the peer's listening socket
+struct yell_peer *yell_findaddr(struct yell *self, struct sockaddr_in sockaddr) {
+	struct yell_peer *peer;
+
+	pthread_mutex_lock(&self->peers_mutex);
+
+	peer = (struct yell_peer *)yell_HT_find(&self->peers_byaddr, &sockaddr);
 
 	pthread_mutex_unlock(&self->peers_mutex);
 
-	// couldn't find peer
-	return NULL;
+	return peer;
 }
 
-int yell_pushpeer(struct yell *self, struct yell_peer *peer) {
+/* Adds the peer, unless another thread added a peer of the same name first; in that case,
+ * or if the peer can't be added, it is freed. Returns the peer that is known by the name, or NULL. */
+struct yell_peer *yell_pushpeer(struct yell *self, struct yell_peer *peer) {
 	const char *fname = "yell_pushpeer()";
 
+	struct yell_peer *known;
+
 	pthread_mutex_lock(&self->peers_mutex);	
 
-	// attempt to insert this peer into linked list
-	if (yell_LL_insert(&self->peers, YELL_LL_TAIL, (void *)peer) == YELL_LL_FAILURE) {
-		fprintf(self->log, "%s: Couldn't insert peer into linked list.\n", fname);
+	// the lookup and the insert are one step, so that a name is never added twice
+	known = (struct yell_peer *)yell_HT_find(&self->peers_byname, peer->name);
+
+	if (known != NULL) {
+		yell_freepeer(self, peer);
+
+		pthread_mutex_unlock(&self->peers_mutex);
 
-		free(peer);
+		return known;
+	}
+
+	// attempt to index this peer, then insert it into linked list
+	if (yell_HT_insert(&self->peers_byname, peer, NULL) == YELL_HT_FAILURE) {
+		yell_log(self, YELL_LOG_ERROR, "%s: Couldn't index peer.\n", fname);
+
+		yell_freepeer(self, peer);
 
 		pthread_mutex_unlock(&self->peers_mutex);	
 
-		return YELL_FAILURE;
+		return NULL;
+	}
+
+	// another node may have held this address before; the newest node keeps it
+	if (yell_HT_insert(&self->peers_byaddr, peer, NULL) == YELL_HT_FAILURE
+	 || yell_LL_insert(&self->peers, YELL_LL_TAIL, (void *)peer) == YELL_LL_FAILURE) {
+		yell_log(self, YELL_LOG_ERROR, "%s: Couldn't insert peer into linked list.\n", fname);
+
+		yell_HT_remove(&self->peers_byname, peer->name);
+
+		if (yell_HT_find(&self->peers_byaddr, &peer->sockaddr) == peer)
+			yell_HT_remove(&self->peers_byaddr, &peer->sockaddr);
+
+		yell_freepeer(self, peer);
+
+		pthread_mutex_unlock(&self->peers_mutex);	
+
+		return NULL;
 	}
 
 	pthread_mutex_unlock(&self->peers_mutex);
 
-	return YELL_SUCCESS;
+	return peer;
 }
 
-int yell_topeer(struct yell *self, struct yell_peer *peer, enum yell_eventtype type, const char *message, char *response) {
-	const char *fname = "yell_topeer";
+// peer->mutex must be held; the connection may still be in progress when this returns
+int yell_openpeer(struct yell *self, struct yell_peer *peer) {
+	const char *fname = "yell_openpeer()";
+
+	int peerfd;
+#ifdef SO_NOSIGPIPE
+	int on = 1;
+#endif
 
-	char packet[PACKET_SIZE + 1];
-	int peerfd, nbytes;
+	// connection is already open
+	if (peer->sockfd >= 0)
+		return YELL_SUCCESS;
 
 	// attempt to open socket
 	peerfd = socket(AF_INET, SOCK_STREAM, 0);
 
 	if (peerfd < 0) {
-		fprintf(self->log, "%s: socket(): %s\n", fname, strerror(errno));
+		yell_log(self, YELL_LOG_ERROR, "%s: socket(): %s\n", fname, strerror(errno));
 
 		return YELL_FAILURE;
 	}
 
+#ifdef SO_NOSIGPIPE
+	// a peer closing the connection shouldn't kill this process
+	setsockopt(peerfd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+
+	// peers are yelled to concurrently, so no single peer may block
+	fcntl(peerfd, F_SETFL, fcntl(peerfd, F_GETFL) | O_NONBLOCK);
+
 	// attempt to connect to peer
 	if (connect(peerfd, (struct sockaddr *)&peer->sockaddr,
-	                    sizeof(struct sockaddr_in)) < 0) {
-		fprintf(self->log, "%s: connect(): %s\n", fname, strerror(errno));
+	                    sizeof(struct sockaddr_in)) < 0 && errno != EINPROGRESS) {
+		yell_log(self, YELL_LOG_WARN, "%s: connect(): %s\n", fname, strerror(errno));
 
 		// close socket
 		close(peerfd);
@@ -81,568 +242,3710 @@ int yell_topeer(struct yell *self, struct yell_peer *peer, enum yell_eventtype t
 		return YELL_FAILURE;
 	}
 
-	// create packet
-	if (message == NULL)
-		sprintf(packet, "%c%s;%d;", (char)type, self->name, self->sockport);
-	else
-		sprintf(packet, "%c%s;%d;%s", (char)type, self->name, self->sockport, message);
+	peer->sockfd = peerfd;
+	peer->last_used = time(NULL);
+	peer->inlen = 0;
 
-	// write message
-	if (write(peerfd, packet, strlen(packet)) < 0) {
-		fprintf(self->log, "%s: write(): %s\n", fname, strerror(errno));
+	if (peer->connected)
+		yell_count(&peer->counters.reconnects, &self->counters.reconnects, 1);
 
-		// close socket
-		close(peerfd);
+	peer->connected = 1;
 
-		return YELL_FAILURE;
-	}
+	return YELL_SUCCESS;
+}
 
-	// read response
-	nbytes = read(peerfd, packet, PACKET_SIZE);
+// peer->mutex must be held
+void yell_closepeer(struct yell_peer *peer) {
+	if (peer->sockfd < 0)
+		return;
 
-	if (nbytes < 0) {
-		fprintf(self->log, "%s: read(): %s\n", fname, strerror(errno));
+	close(peer->sockfd);
+	peer->sockfd = -1;
+}
 
-		// close socket
-		close(peerfd);
+void yell_evictpeers(struct yell *self) {
+	struct yell_LL_node *march;
+	struct yell_peer *peer;
+	time_t now;
 
-		return YELL_FAILURE;
-	}
+	now = time(NULL);
 
-	packet[nbytes] = '\0';
+	pthread_mutex_lock(&self->peers_mutex);
 
-	if (response != NULL)
-		strcpy(response, packet);
-	else
-	if (packet[0] != YET_SUCCESS)
-		fprintf(self->log, "%s: Unhandled response.\n", fname);
+	for (march = self->peers.head; march != NULL; march = march->next) {
+		peer = (struct yell_peer *)march->data;
 
-	// close socket
-	close(peerfd);
+		// a peer that is in use isn't idle
+		if (pthread_mutex_trylock(&peer->mutex) != 0)
+			continue;
 
-	return YELL_SUCCESS;
+		if (peer->sockfd >= 0 && now - peer->last_used > IDLE_TIMEOUT)
+			yell_closepeer(peer);
+
+		pthread_mutex_unlock(&peer->mutex);
+	}
+
+	pthread_mutex_unlock(&self->peers_mutex);
 }
 
-struct yell_event *yell_makeevent(struct yell *self, const char *packet, struct sockaddr_in sockaddr) {
-	const char *fname = "yell_makeevent()";
+// packet must hold FRAME_SIZE bytes; returns the size of the frame
+int yell_makepacket(struct yell *self, char *packet, enum yell_eventtype type, const char *message, size_t length) {
+	// message is truncated
+	if (length > PACKET_SIZE)
+		length = PACKET_SIZE;
 
-	struct yell_event *event;
-	char name[NAME_SIZE + 1];
-	struct yell_peer *peer;
-	int i, j,
-	    sockport;
+	// asking a peer its name also tells it that self accepts compressed frames
+	return yell_frame_make(packet, FRAME_SIZE, type, type == YET_WHOAREYOU || type == YET_CONNECT ? YELL_FRAME_LZ_OK : 0,
+	                       self->name, self->sockport, message, length);
+}
 
-	event = (struct yell_event *)malloc(sizeof(struct yell_event));
+/* Makes the frames of a message, which is split into chunks of PACKET_SIZE if it is larger than that.
+ * The chunks aren't copied, so the message must outlive msg; msg is released with yell_freemessage(). */
+int yell_makemessage(struct yell *self, struct yell_message *msg, enum yell_eventtype type, const char *message, size_t length) {
+	const char *fname = "yell_makemessage()";
 
-	// memory allocation error
-	if (event == NULL) {
-		fprintf(self->log, "%s: Memory allocation error.\n", fname);
+	char   *header;
+	size_t  headerlen, chunklen, off;
+	int     nchunks, lzlen, i;
 
-		return NULL;
-	}
+	msg->headers = NULL;
+	msg->compressed = 0;
+	msg->membership = type == YET_PROBE || type == YET_PROBEREQ || type == YET_PROBEACK;
 
-	// set event type
-	event->type = packet[0];
+	// a small message is one frame
+	if (length <= PACKET_SIZE) {
+		msg->small.iov_base = msg->packet;
+		msg->small.iov_len = yell_makepacket(self, msg->packet, type, message, length);
+		msg->iov = &msg->small;
+		msg->iovcnt = 1;
 
-	// read peer name
-	for (i = 1, j = 0; packet[i] != ';' && packet[i] != '\0'; ++i, ++j) {
-		// name size is exceeded
-		if (j == NAME_SIZE) {
-			// skip characters until a semicolon or end of string is reached
-			while (packet[i] != ';' && packet[i] != '\0')
-				++i;
+		if (length < COMPRESS_THRESHOLD)
+			return YELL_SUCCESS;
 
-			break;
+		// the compressed frame is only used if it is smaller
+		headerlen = YELL_FRAME_HEADER + strlen(self->name);
+		lzlen = yell_LZ_compress(message, length, msg->lzpacket + headerlen, length - 1);
+
+		if (lzlen != YELL_LZ_FAILURE) {
+			yell_frame_header(msg->lzpacket, headerlen, type, YELL_FRAME_LZ, self->name, self->sockport, lzlen);
+
+			msg->lz.iov_base = msg->lzpacket;
+			msg->lz.iov_len = headerlen + lzlen;
+			msg->compressed = 1;
 		}
 
-		name[j] = packet[i];
+		return YELL_SUCCESS;
 	}
 
-	name[j] = '\0';
-
-	// check for invalid syntax
-	if (packet[i] == '\0') {
-		free(event);
+	if (length > MESSAGE_SIZE) {
+		yell_log(self, YELL_LOG_ERROR, "%s: Message is too long.\n", fname);
 
-		return NULL;
+		return YELL_FAILURE;
 	}
 
-	// don't read the semicolon
-	++i;
+	headerlen = YELL_FRAME_HEADER + strlen(self->name);
+	nchunks = (length + PACKET_SIZE - 1) / PACKET_SIZE;
 
-	// read the port of this node
-	for (sockport = 0; packet[i] != ';' && packet[i] != '\0'; ++i) {
-		if (!isdigit(packet[i])) {
-			// skip characters until a semicolon or end of string is reached
-			while (packet[i] != ';' && packet[i] != '\0')
-				++i;
+	msg->headers = (char *)malloc(headerlen * nchunks);
+	msg->iov = (struct iovec *)malloc(sizeof(struct iovec) * 2 * nchunks);
 
-			break;
-		}
+	// memory allocation error
+	if (msg->headers == NULL || msg->iov == NULL) {
+		yell_log(self, YELL_LOG_ERROR, "%s: Memory allocation error.\n", fname);
+
+		free(msg->headers);
+		free(msg->iov);
 
-		sockport = sockport * 10 + packet[i] - '0';
+		return YELL_FAILURE;
 	}
 
-	// check for invalid syntax
-	if (sockport == 0 || packet[i] == '\0') {
-		free(event);
+	// each chunk is a header followed by a piece of the message; every chunk but the last is continued by the next
+	for (i = 0, off = 0; i < nchunks; ++i, off += chunklen) {
+		chunklen = length - off < PACKET_SIZE ? length - off : PACKET_SIZE;
+		header = msg->headers + headerlen * i;
 
-		return NULL;
-	}
+		yell_frame_header(header, headerlen, type, i < nchunks - 1 ? YELL_FRAME_CHUNK | YELL_FRAME_MORE : 0,
+		                  self->name, self->sockport, chunklen);
 
-	// attempt to find the peer associated with this packet
-	peer = yell_findpeer(self, name);
+		msg->iov[2 * i].iov_base = header;
+		msg->iov[2 * i].iov_len = headerlen;
+		msg->iov[2 * i + 1].iov_base = (char *)message + off;
+		msg->iov[2 * i + 1].iov_len = chunklen;
+	}
 
-	if (peer == NULL) {
-		// create the peer
+	msg->iovcnt = 2 * nchunks;
 
-		peer = (struct yell_peer *)malloc(sizeof(struct yell_peer));
+	return YELL_SUCCESS;
+}
 
-		// memory allocation error
-		if (peer == NULL) {
-			fprintf(self->log, "%s: Memory allocation error.\n", fname);
+void yell_freemessage(struct yell_message *msg) {
+	if (msg->headers == NULL)
+		return;
 
-			free(event);
+	free(msg->headers);
+	free(msg->iov);
+}
 
-			return NULL;
-		}
+// result->peer->mutex must be held; opens the connection if needed, and starts sending
+void yell_startsend(struct yell *self, struct yell_result *result) {
+	struct yell_peer *peer = result->peer;
 
-		peer->sockaddr = sockaddr;
-		peer->sockaddr.sin_port = htons(sockport);
-		peer->sockport = sockport;
-		strcpy(peer->name, name);
+	// the pooled connection has idled out
+	if (peer->sockfd >= 0 && time(NULL) - peer->last_used > IDLE_TIMEOUT)
+		yell_closepeer(peer);
 
-		// push this peer
-		yell_pushpeer(self, peer);
-	}
+	result->reused = peer->sockfd >= 0;
+	result->outiov = 0;
+	result->outoff = 0;
 
-	// set the event's peer
-	event->peer = peer;
+	if (yell_openpeer(self, peer) == YELL_FAILURE) {
+		result->state = YSS_DONE;
 
-	if (packet[i] == '\0')
-		// syntax error... assume no body provided
-		event->packet[0] = '\0';
-	else
-		// copy body of packet to event->packet
-		strcpy(event->packet, &packet[i + 1]);
+		return;
+	}
 
-	return event;
+	result->state = result->reused ? YSS_SENDING : YSS_CONNECTING;
 }
 
-int yell_pushevent(struct yell *self, struct yell_event *event) {
-	const char *fname = "yell_pushevent()";
+// result->peer->mutex must be held; returns YELL_FAILURE if the peer has failed
+int yell_stepsend(struct yell_result *result, short revents) {
+	struct yell_peer *peer = result->peer;
 
-	pthread_mutex_lock(&self->events_mutex);
+	struct yell_frame frame;
+	struct iovec      iov[SEND_IOVS];
+	struct msghdr     msg;
+	socklen_t         errlen;
+	ssize_t           nbytes;
+	int               iovcnt, err;
 
-	// attempt to insert event into linked list
-	if (yell_LL_insert(&self->events, YELL_LL_TAIL, event) == YELL_LL_FAILURE) {
-		fprintf(self->log, "%s: Couldn't insert event into linked list.\n", fname);
+	switch (result->state) {
+	case YSS_CONNECTING:
+		if (!(revents & (POLLOUT | POLLERR | POLLHUP)))
+			return YELL_SUCCESS;
 
-		pthread_mutex_unlock(&self->events_mutex);
+		// find out if the connection was made
+		errlen = sizeof(err);
 
-		return YELL_FAILURE;
-	}
+		if (getsockopt(peer->sockfd, SOL_SOCKET, SO_ERROR, &err, &errlen) < 0 || err != 0) {
+			errno = err;
 
-	pthread_mutex_unlock(&self->events_mutex);
+			return YELL_FAILURE;
+		}
 
-	return YELL_SUCCESS;
-}
+		// the socket is writable, so start sending
+		result->state = YSS_SENDING;
 
-struct yell_event *yell_nextevent(struct yell *self) {
-	struct yell_event *event;
+		// fall through
+	case YSS_SENDING:
+		if (!(revents & (POLLOUT | POLLERR | POLLHUP)))
+			return YELL_SUCCESS;
 
-	pthread_mutex_lock(&self->events_mutex);
+		while (result->outiov < result->iovcnt) {
+			// gather what is left of the message, starting partway into the first piece
+			iovcnt = result->iovcnt - result->outiov < SEND_IOVS ? result->iovcnt - result->outiov : SEND_IOVS;
+			memcpy(iov, result->iov + result->outiov, sizeof(struct iovec) * iovcnt);
 
-	event = (struct yell_event *)yell_LL_remove(&self->events, YELL_LL_HEAD);
+			iov[0].iov_base = (char *)iov[0].iov_base + result->outoff;
+			iov[0].iov_len -= result->outoff;
 
-	pthread_mutex_unlock(&self->events_mutex);
+			memset(&msg, 0, sizeof(struct msghdr));
+			msg.msg_iov = iov;
+			msg.msg_iovlen = iovcnt;
 
-	return event;
-}
+			nbytes = sendmsg(peer->sockfd, &msg, MSG_NOSIGNAL);
 
-void *yell_listen(void *self_ptr) {
-	const char *fname = "yell_listen";
+			if (nbytes < 0) {
+				if (errno == EAGAIN || errno == EWOULDBLOCK)
+					return YELL_SUCCESS;
 
-	struct yell *self;  // information on self
-	int len;
+				if (errno == EINTR)
+					continue;
 
-	int                peerfd, nbytes;               // peer socket, number of bytes read
-	struct sockaddr_in sockaddr_self, sockaddr_peer; // addresses
-	socklen_t          addrlen, addrlen_peer;        // size of sockaddr
+				return YELL_FAILURE;
+			}
 
-	struct yell_LL_node *node;
-	struct yell_peer    *peer;
+			// skip the pieces that were sent
+			for (nbytes += result->outoff; result->outiov < result->iovcnt
+			                            && (size_t)nbytes >= result->iov[result->outiov].iov_len; ++result->outiov)
+				nbytes -= result->iov[result->outiov].iov_len;
 
-	char packet[PACKET_SIZE + 1],   // received packet
-	     response[PACKET_SIZE + 1], // packet to send
-	     name[NAME_SIZE + 1],       // name of peer
-	     peer_addrstr[512];
+			result->outoff = nbytes;
+		}
 
-	struct yell_event *event; // created event from a packet
+		result->state = YSS_RECEIVING;
 
-	self = (struct yell *)self_ptr;
+		return YELL_SUCCESS;
+	case YSS_RECEIVING:
+		if (!(revents & (POLLIN | POLLERR | POLLHUP)))
+			return YELL_SUCCESS;
 
-	addrlen = sizeof(struct sockaddr_in);
+		for (;;) {
+			nbytes = read(peer->sockfd, peer->in + peer->inlen, FRAME_SIZE - peer->inlen);
 
-	for (;;) {
-		// safety measure---on occasion, self->sockaddr is overwritten in errors
-		memcpy(&sockaddr_self, &self->sockaddr, sizeof(struct sockaddr_in));
+			if (nbytes < 0) {
+				if (errno == EAGAIN || errno == EWOULDBLOCK)
+					return YELL_SUCCESS;
 
-		// accept a connection queued on the socket
-		peerfd = accept(self->sockfd, (struct sockaddr *)&sockaddr_self, &addrlen);
+				if (errno == EINTR)
+					continue;
 
-		// check if this thread should close
+				return YELL_FAILURE;
+			}
 
-		pthread_mutex_lock(&self->close_mutex);
+			// the peer closed the connection
+			if (nbytes == 0) {
+				errno = ECONNRESET;
 
-		if (self->close)
-			break;
+				return YELL_FAILURE;
+			}
 
-		pthread_mutex_unlock(&self->close_mutex);
+			peer->inlen += nbytes;
 
-		// bad file descriptor
-		if (peerfd < 0) {
-			// no incoming connections; check if thread should close
-			if (errno == EAGAIN || errno == EWOULDBLOCK)
-				continue;
+			nbytes = yell_frame_parse(peer->in, peer->inlen, PACKET_SIZE, &frame);
 
-			// there is a different error; log then break
-			fprintf(self->log, "%s: %s\n", fname, strerror(errno));
+			// the whole response was received
+			if (nbytes > 0)
+				break;
 
-			break;
+			// the response is invalid; treat it as a broken connection
+			if (nbytes < 0) {
+				errno = EPROTO;
+
+				return YELL_FAILURE;
+			}
 		}
 
-		// get the address of the received connection
-		getsockname(peerfd, (struct sockaddr *)&sockaddr_peer, &addrlen_peer);
+		result->status = YELL_SUCCESS;
+		result->reply = frame.type;
 
-		// attempt to receive a packet
-		nbytes = read(peerfd, packet, PACKET_SIZE);
+		if (result->response != NULL)
+			memcpy(result->response, peer->in, nbytes);
 
-		if (nbytes < 0) {
-			fprintf(self->log, "%s: read(): %s\n", fname, strerror(errno));
+		// keep anything that follows the response
+		peer->inlen -= nbytes;
+		memmove(peer->in, peer->in + nbytes, peer->inlen);
+		peer->last_used = time(NULL);
 
-			// close the connection
-			close(peerfd);
+		result->state = YSS_DONE;
 
-			continue;
-		}
+		return YELL_SUCCESS;
+	default:
+	case YSS_DONE:
+		return YELL_SUCCESS;
+	}
+}
+
+int yell_fanout(struct yell *self, struct yell_result *results, struct pollfd *fds, int npeers, const struct yell_message *msg) {
+	return yell_fanoutwithin(self, results, fds, npeers, msg, PEER_TIMEOUT);
+}
 
-		// ensure packet is null-terminated
-		packet[nbytes] = '\0';
+// as yell_fanout(), but a peer times out once it has made no progress for timeout milliseconds
+int yell_fanoutwithin(struct yell *self, struct yell_result *results, struct pollfd *fds, int npeers, const struct yell_message *msg, int timeout) {
+	const char *fname = "yell_fanout";
+
+	struct yell_result *result;
+	int i, j, nactive, wait, elapsed;
+	struct timespec start, now;
+	size_t bytes;
+	char peerstr[PEERSTR_SIZE];
+	int counted;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	// queued messages are always counted; probes never are
+	counted = msg == NULL || !msg->membership;
+
+	/* The message is sent to every peer at once, and responses are collected as they arrive.
+	 * A peer is locked while it is sent to; a peer that another thread is sending to is tried again
+	 * every FANOUT_RETRY milliseconds, rather than holding up the others.
+	 * Without a message, each peer is sent the messages queued for it instead. */
+
+	for (i = 0; i < npeers; ++i) {
+		result = &results[i];
+		result->status = YELL_FAILURE;
+		result->reply = YET_UNKNOWN;
+		result->state = YSS_WAITING;
+		result->progress = 0;
+	}
 
-		// create event from packet
-		event = yell_makeevent(self, packet, sockaddr_peer);
+	for (;;) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		elapsed = (now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000;
 
-		// couldn't create an event---peer is probably sus
-		if (event == NULL) {
-			close(peerfd);
+		// busy peers are waited on for no longer than timeout
+		nactive = yell_trypeers(self, results, npeers, msg, elapsed, timeout);
+		wait = nactive > 0 && FANOUT_RETRY < timeout ? FANOUT_RETRY : timeout;
 
-			continue;
-		}
+		for (i = 0; i < npeers; ++i) {
+			result = &results[i];
 
-		response[0] = YET_FAILURE;
-		response[1] = '\0';
+			fds[i].fd = -1;
+			fds[i].events = 0;
+			fds[i].revents = 0;
 
-		switch (event->type) {
-		case YET_PING:
-			// respond by pinging back
-			response[0] = YET_PING;
+			if (result->state == YSS_DONE || result->state == YSS_WAITING)
+				continue;
 
-			break;
-		case YET_WHOAREYOU:
-			// respond with name of self
-			strcpy(response, self->name);
+			// a peer times out once it has made no progress for timeout, so a large message may take longer
+			if (elapsed - result->progress >= timeout)
+				continue;
+
+			if (timeout - (elapsed - result->progress) < wait)
+				wait = timeout - (elapsed - result->progress);
+
+			fds[i].fd = result->peer->sockfd;
+			fds[i].events = result->state == YSS_RECEIVING ? POLLIN : POLLOUT;
+
+			++nactive;
+		}
 
+		if (nactive == 0)
 			break;
-		case YET_MESSAGE:
-			response[0] = YET_SUCCESS;
-		
+
+		if (poll(fds, npeers, wait) < 0) {
+			if (errno == EINTR)
+				continue;
+
+			yell_log(self, YELL_LOG_ERROR, "%s: poll(): %s\n", fname, strerror(errno));
+
 			break;
-		case YET_CONNECT:
-			response[0] = '\0';
+		}
 
-			pthread_mutex_lock(&self->peers_mutex);	
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		elapsed = (now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000;
 
-			// for every connected peer
-			for (node = self->peers.head; node != NULL; node = node->next) {
-				peer = (struct yell_peer *)node->data;
+		for (i = 0; i < npeers; ++i) {
+			result = &results[i];
 
-				// do not tell peer of its own existence
-				if (peer == event->peer) {
-					if (node->next == NULL)
-						// don't terminate the list with a semicolon
-						response[strlen(response) - 1] = '\0';
+			if (fds[i].revents == 0)
+				continue;
 
-					continue;
-				}
+			result->progress = elapsed;
+
+			if (yell_stepsend(result, fds[i].revents) == YELL_SUCCESS)
+				continue;
+
+			yell_closepeer(result->peer);
 
-				// prepare peer address string
-				if (peer->sockaddr.sin_addr.s_addr == INADDR_ANY)
-					strcpy(peer_addrstr, "127.0.0.1");
-				else
-					inet_ntop(peer->sockaddr.sin_family, &peer->sockaddr.sin_addr, peer_addrstr, INET_ADDRSTRLEN);
-				len = strlen(peer_addrstr);
-				peer_addrstr[len] = ':';
-				sprintf(peer_addrstr + len + 1, "%d", ntohs(peer->sockaddr.sin_port));
+			/* A pooled connection may have been closed by the peer since it was last used;
+			 * in that case, reconnect and try once more. */
 
-				// concatenate this peer to the response
-				strcat(response, peer_addrstr);
+			if (result->reused) {
+				yell_startsend(self, result);
 
-				if (node->next != NULL)
-					strcat(response, ";");
+				// only retry once
+				result->reused = 0;
+
+				continue;
 			}
 
-			pthread_mutex_unlock(&self->peers_mutex);	
+			yell_log(self, YELL_LOG_WARN, "yell_fanout: %s: %s\n", yell_peerstr(peerstr, result->peer->name, result->peer->sockaddr), strerror(errno));
+
+			result->state = YSS_DONE;
+		}
+	}
 
-			printf("%s\n", response);
+	for (i = 0; i < npeers; ++i) {
+		result = &results[i];
 
-			break;
-		case YET_DISCONNECT:
-			// TODO: deal with disconnections
-			response[0] = YET_SUCCESS;
+		// the peer was never free to be sent to
+		if (result->state == YSS_WAITING) {
+			yell_log(self, YELL_LOG_WARN, "yell_fanout: %s: Busy; timed out.\n", yell_peerstr(peerstr, result->peer->name, result->peer->sockaddr));
 
-			break;
-		default:
-		case YET_UNKNOWN:
-			fprintf(self->log, "%s: Unknown packet event type.\n", fname);
+			if (counted)
+				yell_count(&result->peer->counters.failures, &self->counters.failures, 1);
 
 			continue;
 		}
 
-		if (write(peerfd, response, strlen(response)) < 0)
-			fprintf(self->log, "%s: write(): %s\n", fname, strerror(errno));
+		// the peer timed out; its connection is in an unknown state
+		if (result->state != YSS_DONE) {
+			yell_log(self, YELL_LOG_WARN, "yell_fanout: %s: Timed out.\n", yell_peerstr(peerstr, result->peer->name, result->peer->sockaddr));
 
-		// close connection
-		close(peerfd);
+			yell_closepeer(result->peer);
+		}
+
+		pthread_mutex_unlock(&result->peer->mutex);
+
+		if (result->iovcnt == 0 || !counted)
+			continue;
 
-		// handle the event
-		if (self->event_handler(self, event) == YELL_FAILURE) {
-			event = NULL;
+		if (result->status == YELL_SUCCESS) {
+			for (bytes = 0, j = 0; j < result->iovcnt; ++j)
+				bytes += result->iov[j].iov_len;
 
-			free(event);
+			yell_count(&result->peer->counters.sent, &self->counters.sent, result->nmessages);
+			yell_count(&result->peer->counters.sent_bytes, &self->counters.sent_bytes, bytes);
+		} else {
+			yell_count(&result->peer->counters.failures, &self->counters.failures, 1);
 		}
 	}
 
-	return NULL;
+	return YELL_SUCCESS;
 }
 
-int yell_start(FILE *log, struct yell *self, const char *name, int (*event_handler)(struct yell *, struct yell_event *)) {
-	const char *fname = "yell_start";
-	int nchars;
+/* Locks each waiting peer that isn't locked by another thread, and starts sending to it.
+ * A peer that has waited for timeout is left waiting. Returns how many peers may still be locked. */
+int yell_trypeers(struct yell *self, struct yell_result *results, int npeers, const struct yell_message *msg, int elapsed, int timeout) {
+	struct yell_result *result;
+	int nwaiting, i;
 
-	// no log file provided
-	if (log == NULL) {
-		// print to a temporary file
-		self->log = tmpfile();
-	} else {
-		self->log = log;
-	}
+	for (nwaiting = 0, i = 0; i < npeers; ++i) {
+		result = &results[i];
 
-	// copy the name
-	strncpy(self->name, name, NAME_SIZE);
-	nchars = strlen(name);
+		if (result->state != YSS_WAITING || elapsed >= timeout)
+			continue;
 
-	if (nchars > NAME_SIZE)
-		self->name[NAME_SIZE] = '\0';
-	else
-		self->name[nchars] = '\0';
+		if (pthread_mutex_trylock(&result->peer->mutex) != 0) {
+			++nwaiting;
 
-	// open the socket to receive messages
-	self->sockfd = socket(AF_INET, SOCK_STREAM, 0);
+			continue;
+		}
+
+		// a peer that accepts compressed frames is sent the compressed message, if there is one
+		if (msg == NULL) {
+			yell_takequeue(result);
+		} else if (msg->compressed && atomic_load(&result->peer->lz)) {
+			result->iov = &msg->lz;
+			result->iovcnt = 1;
+			result->nmessages = 1;
+		} else {
+			result->iov = msg->iov;
+			result->iovcnt = msg->iovcnt;
+			result->nmessages = 1;
+		}
+
+		result->progress = elapsed;
+
+		// nothing was queued for the peer
+		if (result->iovcnt == 0) {
+			result->status = YELL_SUCCESS;
+			result->state = YSS_DONE;
+
+			continue;
+		}
+
+		yell_startsend(self, result);
+	}
+
+	return nwaiting;
+}
+
+// result->peer->mutex must be held; the queued messages become the batch to be sent
+void yell_takequeue(struct yell_result *result) {
+	struct yell_peer *peer = result->peer;
+	char *batch;
+
+	pthread_mutex_lock(&peer->queue_mutex);
+
+	batch = peer->batch;
+	peer->batch = peer->queue;
+	peer->queue = batch;
+
+	result->queued.iov_base = peer->batch;
+	result->queued.iov_len = peer->queuelen;
+	result->iov = &result->queued;
+	result->iovcnt = peer->queuelen > 0 ? 1 : 0;
+	result->nmessages = peer->queuecount;
+
+	// the peer responds to the last frame of the batch
+	if (peer->queuelen > 0)
+		yell_frame_setflags(peer->batch + peer->lastframe,
+		                    yell_frame_getflags(peer->batch + peer->lastframe) & ~YELL_FRAME_MORE);
+
+	peer->queuelen = 0;
+	peer->queuecount = 0;
+
+	pthread_mutex_unlock(&peer->queue_mutex);
+}
+
+// appends a frame to the queue of the peer; returns the number of bytes queued, or -1 if there is no room
+int yell_queuepacket(struct yell_peer *peer, const char *packet, int len) {
+	int queued;
+
+	pthread_mutex_lock(&peer->queue_mutex);
+
+	if (peer->queuelen + len > PEER_QUEUE_SIZE) {
+		pthread_mutex_unlock(&peer->queue_mutex);
+
+		return -1;
+	}
+
+	if (peer->queuelen == 0)
+		clock_gettime(CLOCK_MONOTONIC, &peer->queued_at);
+
+	memcpy(peer->queue + peer->queuelen, packet, len);
+	peer->lastframe = peer->queuelen;
+	peer->queuelen += len;
+	++peer->queuecount;
+
+	queued = peer->queuelen;
+
+	pthread_mutex_unlock(&peer->queue_mutex);
+
+	return queued;
+}
+
+// sends the queues of peers once their window has passed
+void *yell_flushqueues(void *self_ptr) {
+	const char *fname = "yell_flushqueues()";
+
+	struct yell *self = (struct yell *)self_ptr;
+
+	struct yell_LL_node *march;
+	struct yell_peer    *peer;
+	struct yell_result  *due, *grown;
+	struct pollfd       *fds, *grown_fds, fd;
+	struct timespec      now;
+	eventfd_t            count;
+	int                  size, npeers, ndue, waited, timeout, closing;
+
+	due = NULL;
+	fds = NULL;
+	size = 0;
+
+	fd.fd = self->flush_fd;
+	fd.events = POLLIN;
+
+	for (timeout = -1;;) {
+		// wait for the first window to pass, for a new queue, or for yell_exit()
+		if (poll(&fd, 1, timeout) < 0 && errno != EINTR)
+			yell_log(self, YELL_LOG_ERROR, "%s: poll(): %s\n", fname, strerror(errno));
+
+		eventfd_read(self->flush_fd, &count);
+
+		pthread_mutex_lock(&self->close_mutex);
+		closing = self->close;
+		pthread_mutex_unlock(&self->close_mutex);
+
+		if (closing)
+			break;
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		timeout = -1;
+
+		pthread_mutex_lock(&self->peers_mutex);
+
+		for (npeers = 0, march = self->peers.head; march != NULL; march = march->next)
+			++npeers;
+
+		if (npeers > size) {
+			grown = (struct yell_result *)realloc(due, sizeof(struct yell_result) * npeers);
+
+			if (grown != NULL)
+				due = grown;
+
+			grown_fds = (struct pollfd *)realloc(fds, sizeof(struct pollfd) * npeers);
+
+			if (grown_fds != NULL)
+				fds = grown_fds;
+
+			// memory allocation error; try again later
+			if (grown == NULL || grown_fds == NULL) {
+				yell_log(self, YELL_LOG_ERROR, "%s: Memory allocation error.\n", fname);
+
+				pthread_mutex_unlock(&self->peers_mutex);
+
+				timeout = self->batch_window;
+
+				continue;
+			}
+
+			size = npeers;
+		}
+
+		// peers that are due are listed in the order of self->peers, like any other fan-out
+		for (ndue = 0, march = self->peers.head; march != NULL; march = march->next) {
+			peer = (struct yell_peer *)march->data;
+
+			pthread_mutex_lock(&peer->queue_mutex);
+
+			if (peer->queuelen > 0) {
+				waited = (now.tv_sec - peer->queued_at.tv_sec) * 1000 + (now.tv_nsec - peer->queued_at.tv_nsec) / 1000000;
+
+				if (waited >= self->batch_window) {
+					due[ndue].peer = peer;
+					due[ndue].response = NULL;
+					++ndue;
+				} else if (timeout < 0 || self->batch_window - waited < timeout) {
+					timeout = self->batch_window - waited;
+				}
+			}
+
+			pthread_mutex_unlock(&peer->queue_mutex);
+		}
+
+		pthread_mutex_unlock(&self->peers_mutex);
+
+		if (ndue > 0) {
+			yell_fanout(self, due, fds, ndue, NULL);
+
+			// more windows may have passed during the fan-out
+			timeout = 0;
+		}
+	}
+
+	free(due);
+	free(fds);
+
+	return NULL;
+}
+
+// opens a thread with its own queue of elements of elemsize bytes; the thread is given the worker
+int yell_startworker(struct yell *self, struct yell_worker *worker, size_t capacity, size_t elemsize, void *(*run)(void *)) {
+	const char *fname = "yell_startworker()";
+
+	worker->self = self;
+
+	if (yell_RB_init(&worker->queue, capacity, elemsize) == YELL_RB_FAILURE) {
+		yell_log(self, YELL_LOG_ERROR, "%s: Memory allocation error.\n", fname);
+
+		return YELL_FAILURE;
+	}
+
+	// the semaphore counts what has been queued, so each read is followed by one pop
+	worker->fd = eventfd(0, EFD_SEMAPHORE);
+
+	if (worker->fd < 0) {
+		yell_log(self, YELL_LOG_ERROR, "%s: eventfd(): %s\n", fname, strerror(errno));
+
+		yell_RB_free(&worker->queue);
+
+		return YELL_FAILURE;
+	}
+
+	if (pthread_create(&worker->thread, NULL, run, (void *)worker) != 0) {
+		yell_log(self, YELL_LOG_ERROR, "%s: pthread_create(): %s\n", fname, strerror(errno));
+
+		yell_RB_free(&worker->queue);
+		close(worker->fd);
+
+		return YELL_FAILURE;
+	}
+
+	return YELL_SUCCESS;
+}
+
+// fails if the worker's queue is full
+int yell_pushwork(struct yell_worker *worker, const void *elem) {
+	if (yell_RB_push(&worker->queue, elem) == YELL_RB_FAILURE)
+		return YELL_FAILURE;
+
+	if (eventfd_write(worker->fd, 1) < 0)
+		yell_log(worker->self, YELL_LOG_ERROR, "yell_pushwork(): eventfd_write(): %s\n", strerror(errno));
+
+	return YELL_SUCCESS;
+}
+
+// called by the worker; waits for the next element, and fails once the worker is stopped and its queue is empty
+int yell_waitwork(struct yell_worker *worker, void *elem) {
+	eventfd_t count;
+
+	while (eventfd_read(worker->fd, &count) < 0)
+		if (errno != EINTR)
+			return YELL_FAILURE;
+
+	// yell_stopworkers() adds one to the semaphore that has nothing queued with it
+	return yell_RB_pop(&worker->queue, elem) == YELL_RB_SUCCESS ? YELL_SUCCESS : YELL_FAILURE;
+}
+
+// stops the workers once they have finished everything queued for them
+void yell_stopworkers(struct yell_worker *workers, int nworkers) {
+	int i;
+
+	for (i = 0; i < nworkers; ++i)
+		eventfd_write(workers[i].fd, 1);
+
+	for (i = 0; i < nworkers; ++i) {
+		pthread_join(workers[i].thread, NULL);
+
+		yell_RB_free(&workers[i].queue);
+		close(workers[i].fd);
+	}
+}
+
+// gives a job to the sender of its peer, so that messages to a peer are sent in the order they were submitted
+void yell_pushjob(struct yell *self, struct yell_job *job) {
+	struct yell_worker *sender;
+	char peerstr[PEERSTR_SIZE];
+
+	sender = &self->senders[yell_addrhash(&job->peer->sockaddr) % SEND_WORKERS];
+
+	atomic_fetch_add(&job->submit->remaining, 1);
+
+	yell_holdpeer(job->peer);
+
+	if (yell_pushwork(sender, job) == YELL_FAILURE) {
+		yell_log(self, YELL_LOG_WARN, "yell_pushjob: %s: Send queue is full; dropping message.\n", yell_peerstr(peerstr, job->peer->name, job->peer->sockaddr));
+
+		yell_releasepeer(job->peer);
+		yell_finishjob(self, job->submit, 1);
+	}
+}
+
+// the last job of a submission completes it
+void yell_finishjob(struct yell *self, struct yell_submit *submit, int failed) {
+	const char *fname = "yell_finishjob()";
+
+	if (failed)
+		atomic_fetch_add(&submit->nfailed, 1);
+
+	if (atomic_fetch_sub(&submit->remaining, 1) != 1)
+		return;
+
+	submit->completion.nfailed = atomic_load(&submit->nfailed);
+	submit->completion.status = submit->completion.nfailed == 0 ? YELL_SUCCESS : YELL_FAILURE;
+
+	if (submit->done != NULL) {
+		submit->done(self, &submit->completion);
+	} else if (yell_RB_push(&self->completions, &submit->completion) == YELL_RB_FAILURE) {
+		yell_log(self, YELL_LOG_WARN, "%s: Completion queue is full; dropping completion.\n", fname);
+	} else if (eventfd_write(self->completion_fd, 1) < 0) {
+		yell_log(self, YELL_LOG_ERROR, "%s: eventfd_write(): %s\n", fname, strerror(errno));
+	}
+
+	yell_freemessage(&submit->message);
+	free(submit->copy);
+
+	yell_MP_release(&self->submit_pool, submit);
+}
+
+// sends the jobs given to a sender, one at a time, until it is stopped
+void *yell_sendjobs(void *worker_ptr) {
+	struct yell_worker *sender = (struct yell_worker *)worker_ptr;
+	struct yell *self = sender->self;
+
+	struct yell_job    job;
+	struct yell_result result;
+	struct pollfd      fd;
+
+	while (yell_waitwork(sender, &job) == YELL_SUCCESS) {
+		result.peer = job.peer;
+		result.response = NULL;
+
+		yell_fanout(self, &result, &fd, 1, &job.submit->message);
+
+		yell_releasepeer(job.peer);
+		yell_finishjob(self, job.submit, result.status == YELL_FAILURE);
+	}
+
+	return NULL;
+}
+
+int yell_topeer(struct yell *self, struct yell_peer *peer, enum yell_eventtype type, const char *message, size_t length, char *response) {
+	return yell_topeerwithin(self, peer, type, message, length, response, PEER_TIMEOUT);
+}
+
+int yell_topeerwithin(struct yell *self, struct yell_peer *peer, enum yell_eventtype type, const char *message, size_t length, char *response, int timeout) {
+	const char *fname = "yell_topeer";
+
+	struct yell_message msg;
+	struct yell_result result;
+	struct pollfd fd;
+	struct timespec start, end;
+
+	if (yell_makemessage(self, &msg, type, message, length) == YELL_FAILURE)
+		return YELL_FAILURE;
+
+	result.peer = peer;
+	result.response = response;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	yell_fanoutwithin(self, &result, &fd, 1, &msg, timeout);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	yell_freemessage(&msg);
+
+	if (result.status == YELL_FAILURE)
+		return YELL_FAILURE;
+
+	// probes are kept apart, so that they don't hide the round trips of messages
+	if (msg.membership)
+		yell_HG_record(&self->probe_rtt, (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000);
+	else
+		yell_countrtt(self, peer, (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000);
+
+	if (response == NULL && result.reply != YET_SUCCESS)
+		yell_log(self, YELL_LOG_DEBUG, "%s: Unhandled response.\n", fname);
+
+	return YELL_SUCCESS;
+}
+
+// the payload sizes of the event pools
+const size_t yell_eventclasses[EVENT_CLASSES] = { 32, 256, PACKET_SIZE };
+
+struct yell_event *yell_allocevent(struct yell *self, size_t length) {
+	struct yell_event *event;
+	int i;
+
+	// find the smallest pool whose payloads fit
+	for (i = 0; i < EVENT_CLASSES && yell_eventclasses[i] < length; ++i)
+		;
+
+	// a large message is allocated alone
+	if (i == EVENT_CLASSES)
+		event = (struct yell_event *)malloc(sizeof(struct yell_event) + length + 1);
+	else
+		event = (struct yell_event *)yell_MP_alloc(&self->event_pools[i]);
+
+	if (event == NULL)
+		return NULL;
+
+	// the payload follows the event in the same object
+	event->packet = (char *)(event + 1);
+	event->packet[0] = '\0';
+	event->length = length;
+	event->peer = NULL;
+	event->sizeclass = i < EVENT_CLASSES ? i : -1;
+
+	return event;
+}
+
+void yell_freeevent(struct yell *self, struct yell_event *event) {
+	if (event->peer != NULL)
+		yell_releasepeer(event->peer);
+
+	if (event->sizeclass < 0)
+		free(event);
+	else
+		yell_MP_release(&self->event_pools[event->sizeclass], event);
+}
+
+struct yell_event *yell_makeevent(struct yell *self, const struct yell_frame *frame, struct sockaddr_in sockaddr) {
+	const char *fname = "yell_makeevent()";
+
+	struct yell_event *event;
+	char name[NAME_SIZE + 1];
+	struct yell_peer *peer;
+
+	// check for an invalid name or port
+	if (frame->namelen == 0 || frame->namelen > NAME_SIZE || frame->port == 0)
+		return NULL;
+
+	event = yell_allocevent(self, frame->length);
+
+	// memory allocation error
+	if (event == NULL) {
+		yell_log(self, YELL_LOG_ERROR, "%s: Memory allocation error.\n", fname);
+
+		return NULL;
+	}
+
+	// set event type
+	event->type = frame->type;
+	event->flags = 0;
+
+	// read peer name
+	memcpy(name, frame->name, frame->namelen);
+	name[frame->namelen] = '\0';
+
+	// attempt to find the peer associated with this packet
+	peer = yell_findpeer(self, name);
+
+	if (peer == NULL) {
+		// create the peer, and push it; another thread may have pushed it since
+		peer = yell_createpeer(self, name, sockaddr, frame->port);
+
+		if (peer != NULL)
+			peer = yell_pushpeer(self, peer);
+
+		if (peer == NULL) {
+			yell_freeevent(self, event);
+
+			return NULL;
+		}
+	}
+
+	// set the event's peer, which is held until the event is freed
+	yell_holdpeer(peer);
+	event->peer = peer;
+
+	// probes aren't counted by the sender either
+	if (frame->type != YET_PROBE && frame->type != YET_PROBEREQ && frame->type != YET_PROBEACK) {
+		yell_count(&peer->counters.received, &self->counters.received, 1);
+		yell_count(&peer->counters.received_bytes, &self->counters.received_bytes, YELL_FRAME_HEADER + frame->namelen + frame->length);
+	}
+
+	// copy the payload to event->packet
+	memcpy(event->packet, frame->payload, frame->length);
+	event->packet[frame->length] = '\0';
+
+	return event;
+}
+
+int yell_pushevent(struct yell *self, struct yell_event *event) {
+	const char *fname = "yell_pushevent()";
+
+	// attempt to insert event into ring buffer; the application isn't keeping up if it is full
+	if (yell_RB_push(&self->events, &event) == YELL_RB_FAILURE) {
+		yell_log(self, event->flags & YEF_DATAGRAM ? YELL_LOG_DEBUG : YELL_LOG_WARN, "%s: Event queue is full; dropping event.\n", fname);
+
+		return YELL_FAILURE;
+	}
+
+	// wake the application
+	if (eventfd_write(self->event_fd, 1) < 0)
+		yell_log(self, YELL_LOG_ERROR, "%s: eventfd_write(): %s\n", fname, strerror(errno));
+
+	return YELL_SUCCESS;
+}
+
+/* self->event_fd is readable whenever events may be queued.
+ * It is only cleared once the queue is seen to be empty, so the application should call this until it returns NULL. */
+struct yell_event *yell_nextevent(struct yell *self) {
+	struct yell_event *event;
+	eventfd_t count;
+
+	if (yell_RB_pop(&self->events, &event) == YELL_RB_SUCCESS)
+		return event;
+
+	// the queue is empty; clear the notification
+	eventfd_read(self->event_fd, &count);
+
+	// an event pushed before the notification was cleared would be missed, so check again
+	if (yell_RB_pop(&self->events, &event) == YELL_RB_FAILURE)
+		return NULL;
+
+	// more events may follow this one
+	eventfd_write(self->event_fd, 1);
+
+	return event;
+}
+
+// timeout is in milliseconds; a negative timeout waits forever
+struct yell_event *yell_waitevent(struct yell *self, int timeout) {
+	const char *fname = "yell_waitevent()";
+
+	struct yell_event *event;
+	struct pollfd fd;
+	struct timespec start, now;
+	int remaining;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	fd.fd = self->event_fd;
+	fd.events = POLLIN;
+
+	for (remaining = timeout;;) {
+		event = yell_nextevent(self);
+
+		if (event != NULL)
+			return event;
+
+		if (poll(&fd, 1, remaining) < 0 && errno != EINTR) {
+			yell_log(self, YELL_LOG_ERROR, "%s: poll(): %s\n", fname, strerror(errno));
+
+			return NULL;
+		}
+
+		if (timeout < 0)
+			continue;
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		remaining = timeout - ((now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000);
+
+		// one last look before timing out
+		if (remaining <= 0)
+			return yell_nextevent(self);
+	}
+}
+
+int yell_eventfd(struct yell *self) {
+	return self->event_fd;
+}
+
+/* Hands an event to the worker of its peer, which calls the event handler, so that the listener never waits on the application.
+ * Events from a peer are handled in the order they arrived. The default handler only queues the event, so it is called here. */
+void yell_dispatch(struct yell *self, struct yell_event *event) {
+	const char *fname = "yell_dispatch()";
+
+	struct yell_worker *worker;
+
+	if (self->event_handler == yell_pushevent) {
+		if (self->event_handler(self, event) == YELL_SUCCESS)
+			return;
+	} else {
+		worker = &self->workers[yell_addrhash(&event->peer->sockaddr) % EVENT_WORKERS];
+
+		if (yell_pushwork(worker, &event) == YELL_SUCCESS)
+			return;
+
+		// a dropped datagram is counted, and may be one of many in a burst
+		yell_log(self, event->flags & YEF_DATAGRAM ? YELL_LOG_DEBUG : YELL_LOG_WARN, "%s: Worker queue is full; dropping event.\n", fname);
+	}
+
+	if (event->flags & YEF_DATAGRAM)
+		yell_count(&event->peer->counters.dropped, &self->counters.dropped, 1);
+
+	yell_freeevent(self, event);
+}
+
+// whether every queue an event may be dispatched to has room for nevents more
+int yell_hasroom(struct yell *self, size_t nevents) {
+	int i;
+
+	if (self->event_handler == yell_pushevent)
+		return yell_RB_count(&self->events) + nevents <= EVENT_QUEUE_SIZE;
+
+	for (i = 0; i < EVENT_WORKERS; ++i)
+		if (yell_RB_count(&self->workers[i].queue) + nevents > EVENT_QUEUE_SIZE)
+			return 0;
+
+	return 1;
+}
+
+// calls the event handler for each event given to a worker, until it is stopped
+void *yell_handleevents(void *worker_ptr) {
+	struct yell_worker *worker = (struct yell_worker *)worker_ptr;
+	struct yell *self = worker->self;
+	struct yell_event *event;
+
+	while (yell_waitwork(worker, &event) == YELL_SUCCESS) {
+		// the event handler is responsible for the event if it succeeds
+		if (self->event_handler(self, event) == YELL_FAILURE)
+			yell_freeevent(self, event);
+	}
+
+	return NULL;
+}
+
+// key of the index of gossip seen; the data is the id itself
+const void *yell_gossipid(const void *id) {
+	return id;
+}
+
+size_t yell_idhash(const void *id) {
+	uint64_t hash = *(const uint64_t *)id;
+
+	hash *= 0x9E3779B97F4A7C15ULL;
+
+	return (size_t)(hash ^ hash >> 29);
+}
+
+int yell_idmatch(const void *id, const void *other) {
+	return *(const uint64_t *)id == *(const uint64_t *)other;
+}
+
+// returns 1 if the gossip was seen before; otherwise it is remembered, forgetting the oldest
+int yell_seengossip(struct yell *self, uint64_t id) {
+	uint64_t *slot;
+
+	pthread_mutex_lock(&self->gossip_mutex);
+
+	if (yell_HT_find(&self->gossip_seen, &id) != NULL) {
+		pthread_mutex_unlock(&self->gossip_mutex);
+
+		return 1;
+	}
+
+	slot = &self->gossip_ids[self->gossip_nids % GOSSIP_HISTORY];
+
+	// the history is full; the slot's id is forgotten
+	if (self->gossip_nids >= GOSSIP_HISTORY)
+		yell_HT_remove(&self->gossip_seen, slot);
+
+	*slot = id;
+	++self->gossip_nids;
+
+	// if this fails, the gossip may be delivered twice
+	yell_HT_insert(&self->gossip_seen, slot, NULL);
+
+	pthread_mutex_unlock(&self->gossip_mutex);
+
+	return 0;
+}
+
+/* Picks up to npicks peers at random, other than exclude and origin and peers that have failed or left,
+ * into results, in the order of self->peers; npicks may be GOSSIP_MAX_FANOUT at most. Returns how many were picked. */
+int yell_pickpeers(struct yell *self, struct yell_result *results, int npicks, struct yell_peer *exclude, struct yell_peer *origin) {
+	struct yell_LL_node *march;
+	struct yell_peer    *peer;
+
+	struct yell_result result;
+	int                picks[GOSSIP_MAX_FANOUT], pick;
+	int                npicked, i, j;
+
+	pthread_mutex_lock(&self->peers_mutex);
+
+	/* Pick peers by reservoir sampling, remembering their position in the list.
+	 * gossip_seed is guarded by peers_mutex. */
+
+	for (i = 0, march = self->peers.head; march != NULL; march = march->next) {
+		peer = (struct yell_peer *)march->data;
+
+		if (peer == exclude || peer == origin || atomic_load(&peer->state) >= YPS_FAILED)
+			continue;
+
+		// the i-th candidate takes the place of a pick with probability npicks / (i + 1)
+		j = i < npicks ? i : (int)(rand_r(&self->gossip_seed) % (i + 1));
+
+		if (j < npicks) {
+			results[j].peer = peer;
+			picks[j] = i;
+		}
+
+		++i;
+	}
+
+	npicked = i < npicks ? i : npicks;
+
+	pthread_mutex_unlock(&self->peers_mutex);
+
+	// peers are locked in the order of self->peers, like any other fan-out
+	for (i = 1; i < npicked; ++i) {
+		result = results[i];
+		pick = picks[i];
+
+		for (j = i; j > 0 && picks[j - 1] > pick; --j) {
+			results[j] = results[j - 1];
+			picks[j] = picks[j - 1];
+		}
+
+		results[j] = result;
+		picks[j] = pick;
+	}
+
+	for (i = 0; i < npicked; ++i)
+		results[i].response = NULL;
+
+	return npicked;
+}
+
+/* Sends a gossip frame to a random few peers, other than exclude and origin.
+ * About log2(N) + 1 peers are picked, so that the gossip reaches every peer within a few rounds.
+ * Returns the number of peers it couldn't be sent to, or -1 if no peer could be picked. */
+int yell_spreadgossip(struct yell *self, const struct yell_message *msg, struct yell_peer *exclude, struct yell_peer *origin) {
+	struct yell_LL_node *march;
+
+	struct yell_result results[GOSSIP_MAX_FANOUT];
+	struct pollfd      fds[GOSSIP_MAX_FANOUT];
+	int                npeers, fanout, npicked, nfailed, i;
+
+	pthread_mutex_lock(&self->peers_mutex);
+
+	for (npeers = 0, march = self->peers.head; march != NULL; march = march->next)
+		++npeers;
+
+	pthread_mutex_unlock(&self->peers_mutex);
+
+	for (fanout = 1; fanout < GOSSIP_MAX_FANOUT && 1 << (fanout - 1) < npeers; ++fanout)
+		;
+
+	npicked = yell_pickpeers(self, results, fanout, exclude, origin);
+
+	if (npicked == 0)
+		return -1;
+
+	yell_fanout(self, results, fds, npicked, msg);
+
+	for (nfailed = 0, i = 0; i < npicked; ++i)
+		if (results[i].status == YELL_FAILURE)
+			++nfailed;
+
+	return nfailed;
+}
+
+/* Makes a gossip event into a message from its origin, and queues the gossip to be forwarded.
+ * Fails if the gossip is invalid or was seen before, in which case it should be dropped. */
+int yell_recvgossip(struct yell *self, struct yell_event *event) {
+	const char *fname = "yell_recvgossip()";
+
+	const unsigned char *header = (const unsigned char *)event->packet;
+	struct yell_forward  forward;
+	struct sockaddr_in   sockaddr;
+	struct yell_peer    *origin;
+	char                 name[NAME_SIZE + 1], *forward_payload;
+	uint64_t             id;
+	size_t               namelen;
+	int                  ttl, port, i;
+
+	// gossip is never larger than a frame
+	if (event->length < GOSSIP_HEADER || event->length > PACKET_SIZE)
+		return YELL_FAILURE;
+
+	for (id = 0, i = 0; i < 8; ++i)
+		id = id << 8 | header[i];
+
+	ttl = header[8];
+	namelen = header[9];
+	port = header[10] << 8 | header[11];
+
+	if (namelen == 0 || namelen > NAME_SIZE || port == 0 || event->length < GOSSIP_HEADER + namelen)
+		return YELL_FAILURE;
+
+	if (yell_seengossip(self, id))
+		return YELL_FAILURE;
+
+	memcpy(name, event->packet + GOSSIP_HEADER, namelen);
+	name[namelen] = '\0';
+
+	/* The origin doesn't know its own address, so the first peer to forward the gossip fills it in.
+	 * Until then, the origin is the peer the gossip came from. */
+
+	memset(&sockaddr, 0, sizeof(struct sockaddr_in));
+	sockaddr.sin_family = AF_INET;
+	memcpy(&sockaddr.sin_addr, header + 12, 4);
+
+	if (sockaddr.sin_addr.s_addr == INADDR_ANY) {
+		origin = event->peer;
+		sockaddr.sin_addr = origin->sockaddr.sin_addr;
+	} else {
+		origin = yell_findpeer(self, name);
+
+		// gossip introduces its origin
+		if (origin == NULL) {
+			origin = yell_createpeer(self, name, sockaddr, port);
+
+			if (origin != NULL)
+				origin = yell_pushpeer(self, origin);
+
+			if (origin == NULL)
+				return YELL_FAILURE;
+		}
+	}
+
+	// forward the gossip until its time to live runs out
+	if (ttl > 1) {
+		forward_payload = (char *)malloc(event->length);
+		forward.msg = (struct yell_message *)malloc(sizeof(struct yell_message));
+
+		if (forward_payload == NULL || forward.msg == NULL) {
+			yell_log(self, YELL_LOG_ERROR, "%s: Memory allocation error.\n", fname);
+
+			free(forward.msg);
+		} else {
+			memcpy(forward_payload, event->packet, event->length);
+			forward_payload[8] = ttl - 1;
+			memcpy(forward_payload + 12, &sockaddr.sin_addr, 4);
+
+			// gossip fits in one frame, so the message holds no pointer to the payload
+			yell_makemessage(self, forward.msg, YET_GOSSIP, forward_payload, event->length);
+			forward.from = event->peer;
+			forward.origin = origin;
+
+			yell_holdpeer(forward.from);
+			yell_holdpeer(forward.origin);
+
+			if (yell_RB_push(&self->gossip, &forward) == YELL_RB_FAILURE) {
+				yell_log(self, YELL_LOG_WARN, "%s: Gossip queue is full; not forwarding.\n", fname);
+
+				yell_releasepeer(forward.from);
+				yell_releasepeer(forward.origin);
+				free(forward.msg);
+			} else {
+				eventfd_write(self->gossip_fd, 1);
+			}
+		}
+
+		free(forward_payload);
+	}
+
+	// the event holds the message alone
+	event->length -= GOSSIP_HEADER + namelen;
+	memmove(event->packet, event->packet + GOSSIP_HEADER + namelen, event->length);
+	event->packet[event->length] = '\0';
+
+	event->type = YET_MESSAGE;
+	event->flags |= YEF_GOSSIP;
+
+	yell_holdpeer(origin);
+	yell_releasepeer(event->peer);
+	event->peer = origin;
+
+	return YELL_SUCCESS;
+}
+
+// forwards gossip queued by the listener, so that the listener never waits on a peer
+void *yell_forwardgossip(void *self_ptr) {
+	struct yell *self = (struct yell *)self_ptr;
+	struct yell_forward forward;
+	eventfd_t count;
+	int closing;
+
+	for (;;) {
+		// wait for gossip, or for yell_exit()
+		eventfd_read(self->gossip_fd, &count);
+
+		pthread_mutex_lock(&self->close_mutex);
+		closing = self->close;
+		pthread_mutex_unlock(&self->close_mutex);
+
+		while (yell_RB_pop(&self->gossip, &forward) == YELL_RB_SUCCESS) {
+			if (!closing)
+				yell_spreadgossip(self, forward.msg, forward.from, forward.origin);
+
+			yell_releasepeer(forward.from);
+			yell_releasepeer(forward.origin);
+			free(forward.msg);
+		}
+
+		if (closing)
+			return NULL;
+	}
+}
+
+// queues an update about a peer, or self, to be sent along with probes; an older update about it is replaced
+void yell_putupdate(struct yell *self, const char *name, int state, uint32_t incarnation) {
+	struct yell_update *update;
+	int i;
+
+	pthread_mutex_lock(&self->members_mutex);
+
+	for (i = 0; i < self->nupdates && strcmp(self->updates[i].name, name) != 0; ++i)
+		;
+
+	// the queue is full; the update sent the most times makes room
+	if (i == UPDATE_QUEUE) {
+		for (update = &self->updates[0], i = 1; i < UPDATE_QUEUE; ++i)
+			if (self->updates[i].transmits > update->transmits)
+				update = &self->updates[i];
+	} else {
+		update = &self->updates[i];
+
+		if (i == self->nupdates)
+			++self->nupdates;
+	}
+
+	strcpy(update->name, name);
+	update->state = state;
+	update->incarnation = incarnation;
+	update->transmits = 0;
+
+	pthread_mutex_unlock(&self->members_mutex);
+}
+
+// writes as many of the queued updates as fit into buf; returns the length written, which is 0 if there are none
+size_t yell_packupdates(struct yell *self, char *buf, size_t size) {
+	struct yell_LL_node *march;
+	struct yell_update  *update;
+	unsigned char       *entry;
+	size_t               length, namelen;
+	int                  npeers, limit, count, i, j;
+
+	pthread_mutex_lock(&self->peers_mutex);
+
+	for (npeers = 0, march = self->peers.head; march != NULL; march = march->next)
+		++npeers;
+
+	pthread_mutex_unlock(&self->peers_mutex);
+
+	for (limit = UPDATE_REPEAT; npeers > 0; npeers >>= 1)
+		limit += UPDATE_REPEAT;
+
+	pthread_mutex_lock(&self->members_mutex);
+
+	for (count = 0, length = 1, i = 0; i < self->nupdates && count < 255; ++i) {
+		update = &self->updates[i];
+		namelen = strlen(update->name);
+
+		if (length + 6 + namelen > size)
+			continue;
+
+		entry = (unsigned char *)buf + length;
+		entry[0] = update->state;
+		entry[1] = update->incarnation >> 24;
+		entry[2] = update->incarnation >> 16;
+		entry[3] = update->incarnation >> 8;
+		entry[4] = update->incarnation;
+		entry[5] = namelen;
+		memcpy(entry + 6, update->name, namelen);
+
+		length += 6 + namelen;
+		++count;
+
+		++update->transmits;
+	}
+
+	// updates that have been sent enough times are dropped
+	for (i = 0, j = 0; i < self->nupdates; ++i)
+		if (self->updates[i].transmits < limit)
+			self->updates[j++] = self->updates[i];
+
+	self->nupdates = j;
+
+	pthread_mutex_unlock(&self->members_mutex);
+
+	if (count == 0)
+		return 0;
+
+	buf[0] = count;
+
+	return length;
+}
+
+// applies the updates received along with a probe, or a response to one
+void yell_readupdates(struct yell *self, const char *buf, size_t length) {
+	const unsigned char *entry, *end;
+	struct yell_peer    *peer;
+	char                 name[NAME_SIZE + 1];
+	uint32_t             incarnation;
+	size_t               namelen;
+	int                  count, state, dead, refute, i;
+
+	if (length == 0)
+		return;
+
+	entry = (const unsigned char *)buf;
+	end = entry + length;
+
+	count = *entry++;
+
+	for (i = 0; i < count && end - entry >= 6; ++i, entry += 6 + namelen) {
+		state = entry[0];
+		incarnation = (uint32_t)entry[1] << 24 | (uint32_t)entry[2] << 16 | (uint32_t)entry[3] << 8 | entry[4];
+		namelen = entry[5];
+
+		// the rest of the updates are invalid
+		if (state > YPS_LEFT || namelen == 0 || namelen > NAME_SIZE || (size_t)(end - entry) < 6 + namelen)
+			return;
+
+		memcpy(name, entry + 6, namelen);
+		name[namelen] = '\0';
+
+		// self is suspected, or thought to have failed; refute it with a new incarnation
+		if (strcmp(name, self->name) == 0) {
+			pthread_mutex_lock(&self->members_mutex);
+
+			refute = state != YPS_ALIVE && incarnation >= self->incarnation;
+
+			if (refute)
+				incarnation = ++self->incarnation;
+
+			pthread_mutex_unlock(&self->members_mutex);
+
+			if (refute)
+				yell_putupdate(self, self->name, YPS_ALIVE, incarnation);
+
+			continue;
+		}
+
+		// peers that self doesn't know of are learned of by other means
+		peer = yell_findpeer(self, name);
+
+		if (peer == NULL || atomic_load(&peer->state) >= YPS_FAILED)
+			continue;
+
+		dead = 0;
+
+		pthread_mutex_lock(&self->members_mutex);
+
+		/* A newer incarnation overrides anything said of an older one; within an incarnation,
+		 * suspicion overrides being alive, and failing or leaving overrides both. */
+
+		switch (state) {
+		case YPS_ALIVE:
+			if (incarnation > peer->incarnation) {
+				peer->incarnation = incarnation;
+				atomic_store(&peer->state, YPS_ALIVE);
+			} else {
+				state = -1;
+			}
+
+			break;
+		case YPS_SUSPECT:
+			if (incarnation > peer->incarnation || (incarnation == peer->incarnation && atomic_load(&peer->state) == YPS_ALIVE)) {
+				peer->incarnation = incarnation;
+				atomic_store(&peer->state, YPS_SUSPECT);
+				clock_gettime(CLOCK_MONOTONIC, &peer->suspected_at);
+			} else {
+				state = -1;
+			}
+
+			break;
+		default:
+			// yell_markdead() passes the update on
+			if (incarnation >= peer->incarnation) {
+				peer->incarnation = incarnation;
+				dead = state;
+			}
+
+			state = -1;
+
+			break;
+		}
+
+		pthread_mutex_unlock(&self->members_mutex);
+
+		// pass the update on
+		if (state >= 0)
+			yell_putupdate(self, name, state, incarnation);
+
+		if (dead)
+			yell_markdead(self, peer, dead, 1);
+	}
+}
+
+// the peer didn't respond to a probe, directly or through other peers
+void yell_suspect(struct yell *self, struct yell_peer *peer) {
+	uint32_t incarnation;
+	int state;
+	char peerstr[PEERSTR_SIZE];
+
+	state = YPS_ALIVE;
+
+	if (!atomic_compare_exchange_strong(&peer->state, &state, YPS_SUSPECT))
+		return;
+
+	pthread_mutex_lock(&self->members_mutex);
+
+	clock_gettime(CLOCK_MONOTONIC, &peer->suspected_at);
+	incarnation = peer->incarnation;
+
+	pthread_mutex_unlock(&self->members_mutex);
+
+	yell_log(self, YELL_LOG_INFO, "yell_suspect: %s: Suspected.\n", yell_peerstr(peerstr, peer->name, peer->sockaddr));
+
+	yell_putupdate(self, peer->name, YPS_SUSPECT, incarnation);
+}
+
+/* Marks the peer as failed or left, tells the other peers, and tells the application with a YET_DISCONNECT
+ * unless notify is 0. The peer is removed by the probe thread. */
+void yell_markdead(struct yell *self, struct yell_peer *peer, int state, int notify) {
+	const char *fname = "yell_markdead()";
+
+	struct yell_event *event;
+	uint32_t incarnation;
+	int previous;
+	char peerstr[PEERSTR_SIZE];
+
+	// only the first to mark the peer does the rest
+	for (previous = atomic_load(&peer->state); previous < YPS_FAILED; )
+		if (atomic_compare_exchange_weak(&peer->state, &previous, state))
+			break;
+
+	if (previous >= YPS_FAILED)
+		return;
+
+	pthread_mutex_lock(&self->members_mutex);
+	incarnation = peer->incarnation;
+	pthread_mutex_unlock(&self->members_mutex);
+
+	yell_log(self, YELL_LOG_INFO, "yell_markdead: %s: %s.\n", yell_peerstr(peerstr, peer->name, peer->sockaddr), state == YPS_FAILED ? "Failed" : "Left");
+
+	yell_putupdate(self, peer->name, state, incarnation);
+
+	if (notify) {
+		event = yell_allocevent(self, 0);
+
+		// memory allocation error
+		if (event == NULL) {
+			yell_log(self, YELL_LOG_ERROR, "%s: Memory allocation error.\n", fname);
+		} else {
+			event->type = YET_DISCONNECT;
+			event->flags = state == YPS_FAILED ? YEF_FAILED : 0;
+
+			yell_holdpeer(peer);
+			event->peer = peer;
+
+			yell_dispatch(self, event);
+		}
+	}
+
+	// wake the probe thread to remove the peer
+	if (eventfd_write(self->probe_fd, 1) < 0)
+		yell_log(self, YELL_LOG_ERROR, "%s: eventfd_write(): %s\n", fname, strerror(errno));
+}
+
+/* Removes the peers that have failed or left, and frees those removed at least GRAVE_PERIODS ago that nothing holds.
+ * Until then they are kept in the graveyard. */
+void yell_removedead(struct yell *self) {
+	const char *fname = "yell_removedead()";
+
+	struct yell_LL_node *march;
+	struct yell_peer    *peer;
+	struct timespec      now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	for (;;) {
+		pthread_mutex_lock(&self->peers_mutex);
+
+		for (march = self->graveyard.head; march != NULL; march = march->next) {
+			peer = (struct yell_peer *)march->data;
+
+			if ((now.tv_sec - peer->removed_at.tv_sec) * 1000 + (now.tv_nsec - peer->removed_at.tv_nsec) / 1000000 >= GRAVE_PERIODS * PROBE_PERIOD
+			 && atomic_load(&peer->refs) == 0)
+				break;
+		}
+
+		if (march == NULL) {
+			pthread_mutex_unlock(&self->peers_mutex);
+
+			break;
+		}
+
+		yell_LL_delete(&self->graveyard, peer);
+
+		pthread_mutex_unlock(&self->peers_mutex);
+
+		yell_freepeer(self, peer);
+	}
+
+	for (;;) {
+		pthread_mutex_lock(&self->peers_mutex);
+
+		for (march = self->peers.head; march != NULL; march = march->next)
+			if (atomic_load(&((struct yell_peer *)march->data)->state) >= YPS_FAILED)
+				break;
+
+		if (march == NULL) {
+			pthread_mutex_unlock(&self->peers_mutex);
+
+			return;
+		}
+
+		peer = (struct yell_peer *)march->data;
+
+		yell_LL_delete(&self->peers, peer);
+
+		if (yell_HT_find(&self->peers_byname, peer->name) == peer)
+			yell_HT_remove(&self->peers_byname, peer->name);
+
+		if (yell_HT_find(&self->peers_byaddr, &peer->sockaddr) == peer)
+			yell_HT_remove(&self->peers_byaddr, &peer->sockaddr);
+
+		// the peer is never freed if it can't be put in the graveyard
+		peer->removed_at = now;
+
+		if (yell_LL_insert(&self->graveyard, YELL_LL_TAIL, peer) == YELL_LL_FAILURE)
+			yell_log(self, YELL_LOG_ERROR, "%s: Memory allocation error.\n", fname);
+
+		pthread_mutex_unlock(&self->peers_mutex);
+
+		// wait for a fan-out to the peer to finish, then close its connection; what was queued for it is dropped
+		pthread_mutex_lock(&peer->mutex);
+		yell_closepeer(peer);
+		pthread_mutex_unlock(&peer->mutex);
+
+		pthread_mutex_lock(&peer->queue_mutex);
+		peer->queuelen = 0;
+		peer->queuecount = 0;
+		pthread_mutex_unlock(&peer->queue_mutex);
+	}
+}
+
+// probes the peer, sending and receiving updates; fails if it didn't respond within PROBE_TIMEOUT
+int yell_probe(struct yell *self, struct yell_peer *peer) {
+	struct yell_frame frame;
+	char              payload[PACKET_SIZE], response[FRAME_SIZE];
+	size_t            length;
+
+	length = yell_packupdates(self, payload, PACKET_SIZE);
+
+	if (yell_topeerwithin(self, peer, YET_PROBE, payload, length, response, PROBE_TIMEOUT) == YELL_FAILURE
+	 || yell_frame_parse(response, FRAME_SIZE, PACKET_SIZE, &frame) <= 0 || frame.type != YET_PROBE)
+		return YELL_FAILURE;
+
+	yell_readupdates(self, frame.payload, frame.length);
+
+	return YELL_SUCCESS;
+}
+
+// asks a few other peers to probe target; returns how many agreed to
+int yell_requestprobes(struct yell *self, struct yell_peer *target) {
+	struct yell_message msg;
+	struct yell_result  results[PROBE_INDIRECT];
+	struct pollfd       fds[PROBE_INDIRECT];
+	int                 npicked, nasked, i;
+
+	npicked = yell_pickpeers(self, results, PROBE_INDIRECT, target, NULL);
+
+	if (npicked == 0)
+		return 0;
+
+	if (yell_makemessage(self, &msg, YET_PROBEREQ, target->name, strlen(target->name)) == YELL_FAILURE)
+		return 0;
+
+	yell_fanoutwithin(self, results, fds, npicked, &msg, PROBE_TIMEOUT);
+	yell_freemessage(&msg);
+
+	for (nasked = 0, i = 0; i < npicked; ++i)
+		if (results[i].status == YELL_SUCCESS && results[i].reply == YET_SUCCESS)
+			++nasked;
+
+	return nasked;
+}
+
+// the next peer to probe, going round self->peers; NULL if there are none
+struct yell_peer *yell_nextprobe(struct yell *self) {
+	struct yell_LL_node *march;
+	struct yell_peer    *peer;
+	int                  npeers, i;
+
+	pthread_mutex_lock(&self->peers_mutex);
+
+	for (npeers = 0, march = self->peers.head; march != NULL; march = march->next)
+		++npeers;
+
+	peer = NULL;
+
+	if (npeers > 0) {
+		self->probe_next %= npeers;
+
+		for (i = 0, march = self->peers.head; i < self->probe_next; ++i)
+			march = march->next;
+
+		peer = (struct yell_peer *)march->data;
+		++self->probe_next;
+	}
+
+	pthread_mutex_unlock(&self->peers_mutex);
+
+	return peer;
+}
+
+/* Probes a peer every PROBE_PERIOD, and probes peers on behalf of others as they ask.
+ * A peer that self couldn't reach is suspected at the end of the period, unless another peer reached it,
+ * and a peer that has been suspected for SUSPECT_TIMEOUT has failed. */
+void *yell_probepeers(void *self_ptr) {
+	const char *fname = "yell_probepeers()";
+
+	struct yell *self = (struct yell *)self_ptr;
+
+	struct yell_LL_node  *march;
+	struct yell_peer     *peer, *target, *expired;
+	struct yell_probereq  request;
+	struct timespec       now, next;
+	struct pollfd         fd;
+	eventfd_t             count;
+	int                   timeout, suspected, closing;
+
+	target = NULL;
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+
+	fd.fd = self->probe_fd;
+	fd.events = POLLIN;
+
+	for (;;) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		timeout = (next.tv_sec - now.tv_sec) * 1000 + (next.tv_nsec - now.tv_nsec) / 1000000;
+
+		// wait for the next period, for a requested probe, or for yell_exit()
+		if (timeout > 0 && poll(&fd, 1, timeout) < 0 && errno != EINTR)
+			yell_log(self, YELL_LOG_ERROR, "%s: poll(): %s\n", fname, strerror(errno));
+
+		eventfd_read(self->probe_fd, &count);
+
+		pthread_mutex_lock(&self->close_mutex);
+		closing = self->close;
+		pthread_mutex_unlock(&self->close_mutex);
+
+		if (closing)
+			break;
+
+		// tell the peers that asked that the target responded; if it didn't, say nothing
+		while (yell_RB_pop(&self->probes, &request) == YELL_RB_SUCCESS) {
+			if (yell_probe(self, request.target) == YELL_SUCCESS)
+				yell_topeerwithin(self, request.requester, YET_PROBEACK, request.target->name, strlen(request.target->name),
+				                  NULL, PROBE_TIMEOUT);
+
+			yell_releasepeer(request.target);
+			yell_releasepeer(request.requester);
+		}
+
+		yell_removedead(self);
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+
+		if (now.tv_sec < next.tv_sec || (now.tv_sec == next.tv_sec && now.tv_nsec < next.tv_nsec))
+			continue;
+
+		next.tv_sec = now.tv_sec + PROBE_PERIOD / 1000;
+		next.tv_nsec = now.tv_nsec + PROBE_PERIOD % 1000 * 1000000;
+
+		if (next.tv_nsec >= 1000000000) {
+			++next.tv_sec;
+			next.tv_nsec -= 1000000000;
+		}
+
+		// the last period's target wasn't reached by the peers asked either
+		if (target != NULL && !atomic_load(&target->acked))
+			yell_suspect(self, target);
+
+		target = NULL;
+
+		// suspected peers that didn't refute it in time have failed, one at a time
+		do {
+			expired = NULL;
+
+			pthread_mutex_lock(&self->peers_mutex);
+			pthread_mutex_lock(&self->members_mutex);
+
+			for (march = self->peers.head; march != NULL && expired == NULL; march = march->next) {
+				peer = (struct yell_peer *)march->data;
+				suspected = (now.tv_sec - peer->suspected_at.tv_sec) * 1000 + (now.tv_nsec - peer->suspected_at.tv_nsec) / 1000000;
+
+				if (atomic_load(&peer->state) == YPS_SUSPECT && suspected >= SUSPECT_TIMEOUT)
+					expired = peer;
+			}
+
+			pthread_mutex_unlock(&self->members_mutex);
+			pthread_mutex_unlock(&self->peers_mutex);
+
+			if (expired != NULL)
+				yell_markdead(self, expired, YPS_FAILED, 1);
+		} while (expired != NULL);
+
+		peer = yell_nextprobe(self);
+
+		if (peer == NULL || atomic_load(&peer->state) >= YPS_FAILED || yell_probe(self, peer) == YELL_SUCCESS)
+			continue;
+
+		// the peer didn't respond; ask others to probe it, and suspect it if none of them can by the next period
+		atomic_store(&peer->acked, 0);
+
+		if (yell_requestprobes(self, peer) == 0)
+			yell_suspect(self, peer);
+		else
+			target = peer;
+	}
+
+	return NULL;
+}
+
+int yell_respond(struct yell *self, struct yell_conn *conn, const struct yell_frame *frame) {
+	const char *fname = "yell_respond";
+
+	int len;
+
+	struct yell_LL_node *node;
+	struct yell_peer    *peer;
+
+	enum yell_eventtype type;
+	char                payload[PACKET_SIZE]; // payload of the response
+	unsigned char      *entry;
+	size_t              length, namelen;
+	in_addr_t           addr;
+	int                 total, start, pass, i;
+
+	struct yell_event *event; // created event from a packet
+
+	struct yell_probereq request;
+
+	// create event from packet
+	event = yell_makeevent(self, frame, conn->sockaddr);
+
+	// couldn't create an event---peer is probably sus
+	if (event == NULL)
+		return YELL_FAILURE;
+
+	type = YET_FAILURE;
+	length = 0;
+
+	switch (event->type) {
+	case YET_PING:
+		// respond by pinging back
+		type = YET_PING;
+
+		break;
+	case YET_WHOAREYOU:
+		// the name of self is in the header of every response
+		type = YET_SUCCESS;
+
+		// a peer that doesn't say it accepts compressed frames is an older one
+		atomic_store(&event->peer->lz, (frame->flags & YELL_FRAME_LZ_OK) != 0);
+
+		break;
+	case YET_MESSAGE:
+	case YET_GOSSIP:
+		type = YET_SUCCESS;
+	
+		break;
+	case YET_CONNECT:
+		// the name of self is in the header, so this is also a response to YET_WHOAREYOU
+		type = YET_SUCCESS;
+
+		atomic_store(&event->peer->lz, (frame->flags & YELL_FRAME_LZ_OK) != 0);
+
+		pthread_mutex_lock(&self->peers_mutex);
+
+		// do not tell peer of its own existence, nor of peers that have failed or left
+		for (total = 0, node = self->peers.head; node != NULL; node = node->next)
+			if (node->data != event->peer && atomic_load(&((struct yell_peer *)node->data)->state) < YPS_FAILED)
+				++total;
+
+		/* The list starts with how many peers there are; the peer learns of those that don't fit from others.
+		 * It goes on from a random peer, so that the peers it is asked of don't all list the same ones.
+		 * gossip_seed is guarded by peers_mutex. */
+
+		start = total > 0 ? (int)(rand_r(&self->gossip_seed) % total) : 0;
+		length = CONNECT_HEADER;
+
+		for (pass = 0; pass < 2; ++pass) for (i = 0, node = self->peers.head; node != NULL; node = node->next) {
+			peer = (struct yell_peer *)node->data;
+
+			if (peer == event->peer || atomic_load(&peer->state) >= YPS_FAILED || (i++ >= start) != (pass == 0))
+				continue;
+
+			namelen = strlen(peer->name);
+
+			if (length + 1 + namelen + 6 > PACKET_SIZE)
+				continue;
+
+			entry = (unsigned char *)payload + length;
+			entry[0] = namelen;
+			memcpy(entry + 1, peer->name, namelen);
+
+			// a peer at any address is reachable on the loopback of self
+			if (peer->sockaddr.sin_addr.s_addr == INADDR_ANY)
+				addr = htonl(INADDR_LOOPBACK);
+			else
+				addr = peer->sockaddr.sin_addr.s_addr;
+
+			memcpy(entry + 1 + namelen, &addr, 4);
+			entry[1 + namelen + 4] = peer->sockport >> 8;
+			entry[1 + namelen + 5] = peer->sockport;
+
+			length += 1 + namelen + 6;
+		}
+
+		pthread_mutex_unlock(&self->peers_mutex);
+
+		payload[0] = total >> 8;
+		payload[1] = total;
+
+		break;
+	case YET_PROBE:
+		// updates ride along with probes, and with the responses to them
+		yell_readupdates(self, event->packet, event->length);
+
+		type = YET_PROBE;
+		length = yell_packupdates(self, payload, PACKET_SIZE);
+
+		break;
+	case YET_PROBEREQ:
+		// the probe thread probes the target on behalf of the peer, so that the listener never waits on a peer
+		request.target = event->length <= NAME_SIZE ? yell_findpeer(self, event->packet) : NULL;
+		request.requester = event->peer;
+
+		if (request.target == NULL) {
+			type = YET_FAILURE;
+
+			break;
+		}
+
+		// the request holds both peers until the probe thread is done with it
+		yell_holdpeer(request.target);
+		yell_holdpeer(request.requester);
+
+		if (yell_RB_push(&self->probes, &request) == YELL_RB_FAILURE) {
+			yell_releasepeer(request.target);
+			yell_releasepeer(request.requester);
+
+			type = YET_FAILURE;
+		} else {
+			type = YET_SUCCESS;
+
+			eventfd_write(self->probe_fd, 1);
+		}
+
+		break;
+	case YET_PROBEACK:
+		// another peer reached a peer that self couldn't
+		peer = event->length <= NAME_SIZE ? yell_findpeer(self, event->packet) : NULL;
+
+		if (peer != NULL)
+			atomic_store(&peer->acked, 1);
+
+		type = YET_SUCCESS;
+
+		break;
+	case YET_DISCONNECT:
+		// the peer is leaving; the event itself tells the application
+		yell_markdead(self, event->peer, YPS_LEFT, 0);
+
+		type = YET_SUCCESS;
+
+		break;
+	default:
+	case YET_UNKNOWN:
+		yell_log(self, YELL_LOG_WARN, "%s: Unknown packet event type.\n", fname);
+
+		yell_freeevent(self, event);
+
+		return YELL_FAILURE;
+	}
+
+	// queue the response; yell_readconn ensures there is room. A batch is responded to once, at its end
+	if (!(frame->flags & YELL_FRAME_MORE)) {
+		len = yell_frame_make(conn->out + conn->outlen, CONN_BUFFER_SIZE - conn->outlen,
+		                      type, event->type == YET_WHOAREYOU || event->type == YET_CONNECT ? YELL_FRAME_LZ_OK : 0,
+		                      self->name, self->sockport, payload, length);
+		conn->outlen += len;
+	}
+
+	// membership is handled by self alone
+	if (event->type == YET_PROBE || event->type == YET_PROBEREQ || event->type == YET_PROBEACK) {
+		yell_freeevent(self, event);
+
+		return YELL_SUCCESS;
+	}
+
+	// gossip is handled as a message from its origin, unless it was seen before
+	if (event->type == YET_GOSSIP && yell_recvgossip(self, event) == YELL_FAILURE) {
+		yell_freeevent(self, event);
+
+		return YELL_SUCCESS;
+	}
+
+	// handle the event
+	yell_dispatch(self, event);
+
+	return YELL_SUCCESS;
+}
+
+// appends a chunk to the message being received on the connection; the last chunk completes the message
+int yell_recvchunk(struct yell *self, struct yell_conn *conn, const struct yell_frame *frame) {
+	const char *fname = "yell_recvchunk";
+
+	struct yell_frame whole;
+	char *chunks;
+	size_t size;
+	int status;
+
+	if (conn->chunklen + frame->length > MESSAGE_SIZE) {
+		yell_log(self, YELL_LOG_WARN, "%s: Message is too long.\n", fname);
+
+		return YELL_FAILURE;
+	}
+
+	// grow the buffer by doubling, so that a large message is copied a few times at most
+	if (conn->chunklen + frame->length > conn->chunksize) {
+		for (size = conn->chunksize > 0 ? conn->chunksize : 4 * PACKET_SIZE; size < conn->chunklen + frame->length; size *= 2)
+			;
+
+		chunks = (char *)realloc(conn->chunks, size);
+
+		// memory allocation error
+		if (chunks == NULL) {
+			yell_log(self, YELL_LOG_ERROR, "%s: Memory allocation error.\n", fname);
+
+			return YELL_FAILURE;
+		}
+
+		conn->chunks = chunks;
+		conn->chunksize = size;
+	}
+
+	memcpy(conn->chunks + conn->chunklen, frame->payload, frame->length);
+	conn->chunklen += frame->length;
+
+	if (frame->flags & YELL_FRAME_CHUNK)
+		return YELL_SUCCESS;
+
+	// the last chunk has the header of the whole message
+	whole = *frame;
+	whole.payload = conn->chunks;
+	whole.length = conn->chunklen;
+
+	status = yell_respond(self, conn, &whole);
+
+	// the buffer isn't kept, so that an idle connection doesn't hold on to a large message
+	free(conn->chunks);
+	conn->chunks = NULL;
+	conn->chunklen = 0;
+	conn->chunksize = 0;
+
+	return status;
+}
+
+// decompresses the payload of the frame into buf, which must hold PACKET_SIZE bytes
+int yell_inflate(struct yell *self, struct yell_frame *frame, char *buf) {
+	const char *fname = "yell_inflate";
+
+	int length;
+
+	length = yell_LZ_decompress(frame->payload, frame->length, buf, PACKET_SIZE);
+
+	if (length == YELL_LZ_FAILURE) {
+		yell_log(self, YELL_LOG_WARN, "%s: Invalid compressed payload.\n", fname);
+
+		return YELL_FAILURE;
+	}
+
+	frame->payload = buf;
+	frame->length = length;
+	frame->flags &= ~YELL_FRAME_LZ;
+
+	return YELL_SUCCESS;
+}
+
+int yell_readconn(struct yell *self, struct yell_conn *conn) {
+	const char *fname = "yell_readconn";
+
+	struct yell_frame frame;
+	char inflated[PACKET_SIZE];
+	int nbytes, off;
+
+	for (;;) {
+		// handle every whole frame received, in place, while there is room to respond to it
+		for (off = 0; conn->outlen + FRAME_SIZE <= CONN_BUFFER_SIZE; off += nbytes) {
+			nbytes = yell_frame_parse(conn->in + off, conn->inlen - off, PACKET_SIZE, &frame);
+
+			if (nbytes == 0)
+				break;
+
+			if (nbytes < 0) {
+				yell_log(self, YELL_LOG_WARN, "%s: Invalid frame.\n", fname);
+
+				return YELL_FAILURE;
+			}
+
+			if (frame.flags & YELL_FRAME_LZ && yell_inflate(self, &frame, inflated) == YELL_FAILURE)
+				return YELL_FAILURE;
+
+			// a chunk is held until the rest of its message arrives
+			if (frame.flags & YELL_FRAME_CHUNK || conn->chunklen > 0) {
+				if (yell_recvchunk(self, conn, &frame) == YELL_FAILURE)
+					return YELL_FAILURE;
+			} else if (yell_respond(self, conn, &frame) == YELL_FAILURE) {
+				return YELL_FAILURE;
+			}
+		}
+
+		// discard the handled frames
+		conn->inlen -= off;
+		memmove(conn->in, conn->in + off, conn->inlen);
+
+		// responses are backed up; read more once they have been written
+		if (conn->outlen + FRAME_SIZE > CONN_BUFFER_SIZE)
+			return YELL_SUCCESS;
+
+		nbytes = read(conn->sockfd, conn->in + conn->inlen, CONN_BUFFER_SIZE - conn->inlen);
+
+		if (nbytes < 0) {
+			// everything available has been read
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return YELL_SUCCESS;
+
+			if (errno == EINTR)
+				continue;
+
+			yell_log(self, YELL_LOG_WARN, "%s: read(): %s\n", fname, strerror(errno));
+
+			return YELL_FAILURE;
+		}
+
+		// the peer closed its end of the connection
+		if (nbytes == 0)
+			return YELL_FAILURE;
+
+		conn->inlen += nbytes;
+	}
+}
+
+int yell_writeconn(struct yell *self, struct yell_conn *conn) {
+	const char *fname = "yell_writeconn";
+
+	struct epoll_event event;
+	int nbytes;
+
+	while (conn->outoff < conn->outlen) {
+		nbytes = send(conn->sockfd, conn->out + conn->outoff, conn->outlen - conn->outoff, MSG_NOSIGNAL);
+
+		if (nbytes < 0) {
+			// the socket is full; continue when it is writable
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+
+			if (errno == EINTR)
+				continue;
+
+			yell_log(self, YELL_LOG_WARN, "%s: send(): %s\n", fname, strerror(errno));
+
+			return YELL_FAILURE;
+		}
+
+		conn->outoff += nbytes;
+	}
+
+	// everything was written
+	if (conn->outoff == conn->outlen) {
+		conn->outoff = 0;
+		conn->outlen = 0;
+	}
+
+	// only wait for the socket to be writable when there is something to write
+	event.events = EPOLLIN | (conn->outlen > 0 ? EPOLLOUT : 0);
+	event.data.ptr = conn;
+
+	if (epoll_ctl(self->epollfd, EPOLL_CTL_MOD, conn->sockfd, &event) < 0) {
+		yell_log(self, YELL_LOG_ERROR, "%s: epoll_ctl(): %s\n", fname, strerror(errno));
+
+		return YELL_FAILURE;
+	}
+
+	return YELL_SUCCESS;
+}
+
+// reads every datagram waiting on self->udpfd; a datagram is never responded to
+void yell_readdatagrams(struct yell *self) {
+	const char *fname = "yell_readdatagrams()";
+
+	struct mmsghdr     msgs[DATAGRAM_BATCH];
+	struct iovec       iovs[DATAGRAM_BATCH];
+	struct sockaddr_in addrs[DATAGRAM_BATCH];
+	char               bufs[DATAGRAM_BATCH][DATAGRAM_SIZE];
+	char               controls[DATAGRAM_BATCH][CMSG_SPACE(sizeof(uint32_t))];
+
+	struct yell_frame  frame;
+	struct yell_event *event;
+	struct cmsghdr    *cmsg;
+	struct timespec    pause;
+	uint32_t           overflows;
+	int n, i, waited;
+
+	memset(msgs, 0, sizeof(msgs));
+
+	for (i = 0; i < DATAGRAM_BATCH; ++i) {
+		iovs[i].iov_base = bufs[i];
+		iovs[i].iov_len = DATAGRAM_SIZE;
+
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		msgs[i].msg_hdr.msg_name = &addrs[i];
+	}
+
+	pause.tv_sec = 0;
+	pause.tv_nsec = 1000000;
+
+	for (;;) {
+		// datagrams wait in the socket buffer while the handlers catch up
+		for (waited = 0; waited < DATAGRAM_WAIT && !yell_hasroom(self, DATAGRAM_BATCH); ++waited)
+			nanosleep(&pause, NULL);
+
+		// the lengths of each address and control message are overwritten by the receive
+		for (i = 0; i < DATAGRAM_BATCH; ++i) {
+			msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+			msgs[i].msg_hdr.msg_control = controls[i];
+			msgs[i].msg_hdr.msg_controllen = sizeof(controls[i]);
+		}
+
+		n = recvmmsg(self->udpfd, msgs, DATAGRAM_BATCH, MSG_DONTWAIT, NULL);
+
+		if (n < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+				yell_log(self, YELL_LOG_ERROR, "%s: recvmmsg(): %s\n", fname, strerror(errno));
+
+			return;
+		}
+
+#ifdef SO_RXQ_OVFL
+		// the system counts the datagrams it dropped since the socket was opened, and the last datagram has the latest count
+		for (cmsg = n > 0 ? CMSG_FIRSTHDR(&msgs[n - 1].msg_hdr) : NULL; cmsg != NULL; cmsg = CMSG_NXTHDR(&msgs[n - 1].msg_hdr, cmsg)) {
+			if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SO_RXQ_OVFL)
+				continue;
+
+			memcpy(&overflows, CMSG_DATA(cmsg), sizeof(overflows));
+
+			if (overflows != self->udp_overflows) {
+				// the sender of a dropped datagram is unknown, so only the total counts it
+				atomic_fetch_add_explicit(&self->counters.dropped, overflows - self->udp_overflows, memory_order_relaxed);
+				self->udp_overflows = overflows;
+			}
+		}
+#endif
+
+		for (i = 0; i < n; ++i) {
+			// a truncated datagram holds part of a frame
+			if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC)
+				continue;
+
+			// each datagram holds exactly one frame; only messages are sent as datagrams
+			if (yell_frame_parse(bufs[i], msgs[i].msg_len, PACKET_SIZE, &frame) != (int)msgs[i].msg_len
+			 || frame.type != YET_MESSAGE)
+				continue;
+
+			event = yell_makeevent(self, &frame, addrs[i]);
+
+			if (event == NULL)
+				continue;
+
+			event->flags |= YEF_DATAGRAM;
+
+			yell_dispatch(self, event);
+		}
+
+		// the socket has been drained
+		if (n < DATAGRAM_BATCH)
+			return;
+	}
+}
+
+/* Marks the connection that has been idle the longest to be closed by the sweep of yell_listen().
+ * A connection is idle when it holds no part of a frame or response; fails if none is. */
+int yell_evictconn(struct yell_conn **conns, int nconns) {
+	struct yell_conn *conn, *lru;
+	int i;
+
+	lru = NULL;
+
+	for (i = 0; i < nconns; ++i) {
+		conn = conns[i];
+
+		// already marked, by a failure or an earlier eviction
+		if (conn->last_used == 0)
+			return YELL_SUCCESS;
+
+		if (conn->inlen != 0 || conn->outlen != 0 || conn->chunks != NULL)
+			continue;
+
+		if (lru == NULL || conn->last_used < lru->last_used)
+			lru = conn;
+	}
+
+	if (lru == NULL)
+		return YELL_FAILURE;
+
+	lru->last_used = 0;
+
+	return YELL_SUCCESS;
+}
+
+void *yell_listen(void *self_ptr) {
+	const char *fname = "yell_listen";
+
+	struct yell *self;  // information on self
+
+	/* Each connection from a peer is kept open so that its pooled connection may be reused.
+	 * The listening sockets and wakefd are told apart from connections by their data pointer. */
+
+	struct yell_conn   *conns[MAX_PEER_CONNECTIONS], *conn;
+	struct epoll_event  events[MAX_CONNECTIONS + 3], event;
+	int                 nconns, nevents, i;
+
+	int                peerfd;        // peer socket
+	struct sockaddr_in sockaddr_peer; // address of peer
+	socklen_t          addrlen;       // size of sockaddr
+	time_t             now, last_sweep;
+
+	self = (struct yell *)self_ptr;
+
+	nconns = 0;
+	last_sweep = time(NULL);
+
+	for (;;) {
+		// wake up every second to sweep idle connections
+		nevents = epoll_wait(self->epollfd, events, MAX_CONNECTIONS + 3, 1000);
+
+		if (nevents < 0) {
+			if (errno == EINTR)
+				continue;
+
+			yell_log(self, YELL_LOG_ERROR, "%s: epoll_wait(): %s\n", fname, strerror(errno));
+
+			break;
+		}
+
+		// check if this thread should close
+
+		pthread_mutex_lock(&self->close_mutex);
+
+		if (self->close) {
+			pthread_mutex_unlock(&self->close_mutex);
+
+			break;
+		}
+
+		pthread_mutex_unlock(&self->close_mutex);
+
+		now = time(NULL);
+
+		for (i = 0; i < nevents; ++i) {
+			// yell_exit() wrote to wakefd; the close flag was checked above
+			if (events[i].data.ptr == &self->wakefd)
+				continue;
+
+			// datagrams are handled as they arrive, and have no connection
+			if (events[i].data.ptr == &self->udpfd) {
+				yell_readdatagrams(self);
+
+				continue;
+			}
+
+			// accept every connection queued on the socket
+			if (events[i].data.ptr == &self->sockfd) {
+				for (;;) {
+					/* The connection idle the longest is closed by the sweep below, since it may have an event
+					 * later in this batch; the new connection waits in the backlog until then. */
+					if (nconns == MAX_PEER_CONNECTIONS) {
+						if (yell_evictconn(conns, nconns) == YELL_FAILURE) {
+							yell_log(self, YELL_LOG_WARN, "%s: Too many connections.\n", fname);
+
+							// refuse the connection, rather than be woken for it again
+							if ((peerfd = accept(self->sockfd, NULL, NULL)) >= 0)
+								close(peerfd);
+						}
+
+						break;
+					}
+
+					addrlen = sizeof(struct sockaddr_in);
+					peerfd = accept(self->sockfd, (struct sockaddr *)&sockaddr_peer, &addrlen);
+
+					if (peerfd < 0) {
+						if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+							yell_log(self, YELL_LOG_ERROR, "%s: accept(): %s\n", fname, strerror(errno));
+
+						break;
+					}
+
+					conn = (struct yell_conn *)malloc(sizeof(struct yell_conn));
+
+					// memory allocation error
+					if (conn == NULL) {
+						yell_log(self, YELL_LOG_ERROR, "%s: Memory allocation error.\n", fname);
+
+						close(peerfd);
+
+						continue;
+					}
+
+					fcntl(peerfd, F_SETFL, fcntl(peerfd, F_GETFL) | O_NONBLOCK);
+
+					conn->sockfd = peerfd;
+					conn->sockaddr = sockaddr_peer;
+					conn->last_used = now;
+					conn->inlen = 0;
+					conn->outlen = 0;
+					conn->outoff = 0;
+					conn->chunks = NULL;
+					conn->chunklen = 0;
+					conn->chunksize = 0;
+
+					event.events = EPOLLIN;
+					event.data.ptr = conn;
+
+					if (epoll_ctl(self->epollfd, EPOLL_CTL_ADD, peerfd, &event) < 0) {
+						yell_log(self, YELL_LOG_ERROR, "%s: epoll_ctl(): %s\n", fname, strerror(errno));
+
+						close(peerfd);
+						free(conn);
+
+						continue;
+					}
+
+					conns[nconns++] = conn;
+				}
+
+				continue;
+			}
+
+			conn = (struct yell_conn *)events[i].data.ptr;
+			conn->last_used = now;
+
+			// an error or hang up is noticed by the read or write that follows
+			if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+				if (yell_readconn(self, conn) == YELL_FAILURE) {
+					// a dead connection is closed in the sweep below
+					conn->last_used = 0;
+
+					continue;
+				}
+			}
+
+			if (yell_writeconn(self, conn) == YELL_FAILURE)
+				conn->last_used = 0;
+		}
+
+		// the sweep closes connections that failed above, so it follows them
+		for (i = 0; i < nconns; ++i) {
+			conn = conns[i];
+
+			// peers close their own idle connections first; this is for peers that vanished
+			if (conn->last_used != 0 && now - conn->last_used <= 2 * IDLE_TIMEOUT)
+				continue;
+
+			// closing the socket removes it from the epoll set
+			close(conn->sockfd);
+			free(conn->chunks);
+			free(conn);
+
+			// move the last connection into its place
+			conns[i--] = conns[--nconns];
+		}
+
+		// close pooled connections to peers that have idled out
+		if (now != last_sweep) {
+			yell_evictpeers(self);
+
+			last_sweep = now;
+		}
+	}
+
+	for (i = 0; i < nconns; ++i) {
+		close(conns[i]->sockfd);
+		free(conns[i]->chunks);
+		free(conns[i]);
+	}
+
+	return NULL;
+}
+
+void yell_closefds(struct yell *self) {
+	if (self->probe_fd >= 0)
+		close(self->probe_fd);
+
+	if (self->completion_fd >= 0)
+		close(self->completion_fd);
+
+	if (self->flush_fd >= 0)
+		close(self->flush_fd);
+
+	if (self->gossip_fd >= 0)
+		close(self->gossip_fd);
+
+	if (self->event_fd >= 0)
+		close(self->event_fd);
+
+	if (self->wakefd >= 0)
+		close(self->wakefd);
+
+	if (self->epollfd >= 0)
+		close(self->epollfd);
+
+	close(self->udpfd);
+	close(self->sockfd);
+}
+
+int yell_start(FILE *log, struct yell *self, const char *name, int (*event_handler)(struct yell *, struct yell_event *)) {
+	const char *fname = "yell_start";
+	struct epoll_event event;
+	int nchars, bufsize, i, j;
+#ifdef SO_RXQ_OVFL
+	int on = 1;
+#endif
+
+	// no log file provided
+	if (log == NULL) {
+		// print to a temporary file, which is kept from growing without bound
+		self->log = tmpfile();
+		self->log_owned = 1;
+	} else {
+		self->log = log;
+		self->log_owned = 0;
+	}
+
+	// the log is written out by whoever logs until the log thread is started
+	atomic_init(&self->log_async, 0);
+	atomic_init(&self->log_dropped, 0);
+	pthread_mutex_init(&self->log_mutex, NULL);
+
+	// copy the name
+	strncpy(self->name, name, NAME_SIZE);
+	nchars = strlen(name);
+
+	if (nchars > NAME_SIZE)
+		self->name[NAME_SIZE] = '\0';
+	else
+		self->name[nchars] = '\0';
+
+	// open the socket to receive messages
+	self->sockfd = socket(AF_INET, SOCK_STREAM, 0);
+
+	// fail if couldn't open socket
+	if (self->sockfd < 0) {
+		yell_log(self, YELL_LOG_ERROR, "%s: socket(): %s\n", fname, strerror(errno));
+
+		return YELL_FAILURE;
+	}
+
+	// prepare ipv4 internet address
+
+	memset(&self->sockaddr, 0, sizeof(struct sockaddr_in));
+
+	self->sockaddr.sin_family = AF_INET;
+	// listen to any incoming connections
+	self->sockaddr.sin_addr.s_addr = INADDR_ANY;
+
+	// open the socket to receive datagrams
+	self->udpfd = socket(AF_INET, SOCK_DGRAM, 0);
+
+	if (self->udpfd < 0) {
+		yell_log(self, YELL_LOG_ERROR, "%s: socket(): %s\n", fname, strerror(errno));
+
+		close(self->sockfd);
+
+		return YELL_FAILURE;
+	}
+
+	// the default buffers hold only a few batches; a buffer that is too small only drops more datagrams
+	bufsize = DATAGRAM_BUFFER;
+
+	setsockopt(self->udpfd, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+	setsockopt(self->udpfd, SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(bufsize));
+
+	self->udp_overflows = 0;
+
+#ifdef SO_RXQ_OVFL
+	// each datagram received is told how many were dropped before it, so that they may be counted
+	setsockopt(self->udpfd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on));
+#endif
+
+	// find a port available to both sockets
+	for (self->sockport = MIN_PORT; self->sockport < MAX_PORT; ++self->sockport) {
+		self->sockaddr.sin_port = htons(self->sockport);
+
+		// attempt to bind
+		if (bind(self->sockfd, (struct sockaddr *)&self->sockaddr,
+		                       sizeof(struct sockaddr_in)) != 0)
+			continue;
+
+		// break loop on success
+		if (bind(self->udpfd, (struct sockaddr *)&self->sockaddr,
+		                      sizeof(struct sockaddr_in)) == 0)
+			break;
+
+		// a bound socket can't be bound again, so try the next port with a new one
+		close(self->sockfd);
+		self->sockfd = socket(AF_INET, SOCK_STREAM, 0);
+
+		if (self->sockfd < 0) {
+			yell_log(self, YELL_LOG_ERROR, "%s: socket(): %s\n", fname, strerror(errno));
+
+			close(self->udpfd);
+
+			return YELL_FAILURE;
+		}
+	}
+
+	// couldn't find an available port
+	if (self->sockport == MAX_PORT) {
+		yell_log(self, YELL_LOG_ERROR, "%s: bind(): %s\n", fname, strerror(errno));
+
+		// close the sockets
+		close(self->udpfd);
+		close(self->sockfd);
+
+		return YELL_FAILURE;
+	}
+
+	// attempt to start listening for connections
+	if (listen(self->sockfd, MAX_CONNECTIONS) < 0) {
+		yell_log(self, YELL_LOG_ERROR, "%s: listen(): %s\n", fname, strerror(errno));
+
+		// close the sockets
+		close(self->udpfd);
+		close(self->sockfd);
+
+		return YELL_FAILURE;
+	}
+
+	// the listener accepts until there is nothing left to accept
+	fcntl(self->sockfd, F_SETFL, fcntl(self->sockfd, F_GETFL) | O_NONBLOCK);
+
+	// prepare the epoll set of the listener, with the listening socket and wakefd
+	self->epollfd = epoll_create1(0);
+	self->wakefd = eventfd(0, EFD_NONBLOCK);
+
+	// the application may poll event_fd for queued events
+	self->event_fd = eventfd(0, EFD_NONBLOCK);
+
+	// the gossip thread blocks on gossip_fd, and the flush thread polls flush_fd
+	self->gossip_fd = eventfd(0, 0);
+	self->flush_fd = eventfd(0, EFD_NONBLOCK);
+
+	// the application may poll completion_fd for queued completions
+	self->completion_fd = eventfd(0, EFD_NONBLOCK);
+
+	// the probe thread polls probe_fd
+	self->probe_fd = eventfd(0, EFD_NONBLOCK);
+
+	if (self->epollfd < 0 || self->wakefd < 0 || self->event_fd < 0 || self->gossip_fd < 0 || self->flush_fd < 0
+	 || self->completion_fd < 0 || self->probe_fd < 0) {
+		yell_log(self, YELL_LOG_ERROR, "%s: epoll_create1()/eventfd(): %s\n", fname, strerror(errno));
+
+		yell_closefds(self);
+
+		return YELL_FAILURE;
+	}
+
+	event.events = EPOLLIN;
+	event.data.ptr = &self->sockfd;
+
+	if (epoll_ctl(self->epollfd, EPOLL_CTL_ADD, self->sockfd, &event) < 0) {
+		yell_log(self, YELL_LOG_ERROR, "%s: epoll_ctl(): %s\n", fname, strerror(errno));
+
+		yell_closefds(self);
+
+		return YELL_FAILURE;
+	}
+
+	event.events = EPOLLIN;
+	event.data.ptr = &self->udpfd;
+
+	if (epoll_ctl(self->epollfd, EPOLL_CTL_ADD, self->udpfd, &event) < 0) {
+		yell_log(self, YELL_LOG_ERROR, "%s: epoll_ctl(): %s\n", fname, strerror(errno));
+
+		yell_closefds(self);
+
+		return YELL_FAILURE;
+	}
+
+	event.events = EPOLLIN;
+	event.data.ptr = &self->wakefd;
+
+	if (epoll_ctl(self->epollfd, EPOLL_CTL_ADD, self->wakefd, &event) < 0) {
+		yell_log(self, YELL_LOG_ERROR, "%s: epoll_ctl(): %s\n", fname, strerror(errno));
+
+		yell_closefds(self);
+
+		return YELL_FAILURE;
+	}
+
+	// socket is prepared; initialize data
+
+	self->close = 0;
+	pthread_mutex_init(&self->close_mutex, NULL);
+
+	// set event handler
+	if (event_handler == NULL)
+		self->event_handler = yell_pushevent;
+	else
+		self->event_handler = event_handler;
+
+	// initialize pools of events and peers
+	for (i = 0; i < EVENT_CLASSES; ++i)
+		yell_MP_init(&self->event_pools[i], sizeof(struct yell_event) + yell_eventclasses[i] + 1, EVENT_SLAB_SIZE);
+
+	yell_MP_init(&self->peer_pool, sizeof(struct yell_peer), PEER_SLAB_SIZE);
+	yell_MP_init(&self->submit_pool, sizeof(struct yell_submit), SUBMIT_SLAB_SIZE);
+
+	// nothing has been sent or received
+	memset(&self->counters, 0, sizeof(self->counters));
+	yell_HG_init(&self->rtt);
+	yell_HG_init(&self->probe_rtt);
+
+	// initialize events and completions ring buffers
+	if (yell_RB_init(&self->events, EVENT_QUEUE_SIZE, sizeof(struct yell_event *)) == YELL_RB_FAILURE
+	 || yell_RB_init(&self->completions, COMPLETION_QUEUE_SIZE, sizeof(struct yell_completion)) == YELL_RB_FAILURE) {
+		yell_log(self, YELL_LOG_ERROR, "%s: Memory allocation error.\n", fname);
+
+		yell_closefds(self);
+
+		return YELL_FAILURE;
+	}
+
+	// initialize peers linked list
+	self->peers.head = NULL;
+	self->peers.tail = NULL;
+	pthread_mutex_init(&self->peers_mutex, NULL);
+
+	// initialize peer indexes
+	if (yell_HT_init(&self->peers_byname, yell_peername, yell_HT_strhash, yell_namematch) == YELL_HT_FAILURE
+	 || yell_HT_init(&self->peers_byaddr, yell_peeraddr, yell_addrhash, yell_addrmatch) == YELL_HT_FAILURE) {
+		yell_log(self, YELL_LOG_ERROR, "%s: Memory allocation error.\n", fname);
+
+		yell_closefds(self);
+
+		return YELL_FAILURE;
+	}
+
+	// fan-out buffers grow with the first broadcast
+	self->fanout = NULL;
+	self->fanout_fds = NULL;
+	self->fanout_size = 0;
+	pthread_mutex_init(&self->fanout_mutex, NULL);
+
+	// gossip ids are unique to self, and count up from a random start
+	self->gossip_nids = 0;
+	self->gossip_seed = time(NULL) ^ getpid() ^ self->sockport;
+	self->gossip_next = (uint64_t)(rand_r(&self->gossip_seed) ^ yell_HT_strhash(self->name)) << 32;
+	pthread_mutex_init(&self->gossip_mutex, NULL);
+
+	// self starts out alive, in its first incarnation
+	self->incarnation = 0;
+	self->nupdates = 0;
+	self->probe_next = 0;
+	pthread_mutex_init(&self->members_mutex, NULL);
+
+	self->graveyard.head = NULL;
+	self->graveyard.tail = NULL;
+
+	if (yell_HT_init(&self->gossip_seen, yell_gossipid, yell_idhash, yell_idmatch) == YELL_HT_FAILURE
+	 || yell_RB_init(&self->gossip, GOSSIP_QUEUE_SIZE, sizeof(struct yell_forward)) == YELL_RB_FAILURE
+	 || yell_RB_init(&self->probes, PROBE_QUEUE_SIZE, sizeof(struct yell_probereq)) == YELL_RB_FAILURE) {
+		yell_log(self, YELL_LOG_ERROR, "%s: Memory allocation error.\n", fname);
+
+		yell_closefds(self);
+
+		return YELL_FAILURE;
+	}
+
+	// attempt to open gossip thread
+	if (pthread_create(&self->gossip_thread, NULL,
+	                   yell_forwardgossip, (void *)self) != 0) {
+		yell_log(self, YELL_LOG_ERROR, "%s: pthread_create(): %s\n", fname, strerror(errno));
+
+		yell_closefds(self);
+
+		return YELL_FAILURE;
+	}
+
+	// queues are sent as they fill up, or once they have waited this long
+	self->batch_window = BATCH_WINDOW;
+	self->batch_bytes = BATCH_BYTES;
+
+	// attempt to open flush thread
+	if (pthread_create(&self->flush_thread, NULL,
+	                   yell_flushqueues, (void *)self) != 0) {
+		yell_log(self, YELL_LOG_ERROR, "%s: pthread_create(): %s\n", fname, strerror(errno));
+
+		// stop the gossip thread
+		self->close = 1;
+		eventfd_write(self->gossip_fd, 1);
+		pthread_join(self->gossip_thread, NULL);
+
+		yell_closefds(self);
+
+		return YELL_FAILURE;
+	}
+
+	// attempt to open probe thread
+	if (pthread_create(&self->probe_thread, NULL,
+	                   yell_probepeers, (void *)self) != 0) {
+		yell_log(self, YELL_LOG_ERROR, "%s: pthread_create(): %s\n", fname, strerror(errno));
+
+		// stop the gossip and flush threads
+		self->close = 1;
+		eventfd_write(self->gossip_fd, 1);
+		eventfd_write(self->flush_fd, 1);
+		pthread_join(self->gossip_thread, NULL);
+		pthread_join(self->flush_thread, NULL);
+
+		yell_closefds(self);
+
+		return YELL_FAILURE;
+	}
+
+	// attempt to open sender threads, then event workers
+	for (i = 0; i < SEND_WORKERS; ++i)
+		if (yell_startworker(self, &self->senders[i], SEND_QUEUE_SIZE, sizeof(struct yell_job), yell_sendjobs) == YELL_FAILURE)
+			break;
+
+	for (j = 0; i == SEND_WORKERS && j < EVENT_WORKERS; ++j)
+		if (yell_startworker(self, &self->workers[j], EVENT_QUEUE_SIZE, sizeof(struct yell_event *), yell_handleevents) == YELL_FAILURE)
+			break;
+
+	// attempt to open listen thread
+	if (i < SEND_WORKERS || j < EVENT_WORKERS || pthread_create(&self->listen_thread, NULL,
+	                                                            yell_listen, (void *)self) != 0) {
+		if (i == SEND_WORKERS && j == EVENT_WORKERS)
+			yell_log(self, YELL_LOG_ERROR, "%s: pthread_create(): %s\n", fname, strerror(errno));
+
+		yell_stopworkers(self->workers, j);
+		yell_stopworkers(self->senders, i);
+
+		// stop the gossip, flush and probe threads
+		self->close = 1;
+		eventfd_write(self->gossip_fd, 1);
+		eventfd_write(self->flush_fd, 1);
+		eventfd_write(self->probe_fd, 1);
+		pthread_join(self->gossip_thread, NULL);
+		pthread_join(self->flush_thread, NULL);
+		pthread_join(self->probe_thread, NULL);
+
+		yell_closefds(self);
+
+		return YELL_FAILURE;
+	}
+
+	// from here on, the log is written out by the log thread
+	yell_startlog(self);
+
+	return YELL_SUCCESS;
+}
+
+struct yell_peer *yell_addpeer(struct yell *self, const char *addr, int port) {
+	const char *fname = "yell_addpeer";
+
+	struct yell_peer *peer, *known;
+	struct sockaddr_in sockaddr;
+	struct yell_frame frame;
+	char response[FRAME_SIZE],
+	     name[NAME_SIZE + 1];
+
+	memset(&sockaddr, 0, sizeof(struct sockaddr_in));
+
+	sockaddr.sin_family = AF_INET;
+	sockaddr.sin_addr.s_addr = inet_addr(addr);
+	sockaddr.sin_port = htons(port);
+
+	// this node is already a peer; no need to ask its name
+	known = yell_findaddr(self, sockaddr);
+
+	if (known != NULL)
+		return known;
+
+	peer = yell_createpeer(self, "", sockaddr, port);
+
+	if (peer == NULL)
+		return NULL;
+
+	// receive node's name, which is in the header of its response
+	if (yell_topeer(self, peer, YET_WHOAREYOU, NULL, 0, response) == YELL_FAILURE
+	 || yell_frame_parse(response, FRAME_SIZE, PACKET_SIZE, &frame) <= 0
+	 || frame.namelen == 0 || frame.namelen > NAME_SIZE) {
+		yell_log(self, YELL_LOG_WARN, "%s: Couldn't message peer.\n", fname);
+
+		yell_freepeer(self, peer);
+
+		return NULL;
+	}
+
+	memcpy(name, frame.name, frame.namelen);
+	name[frame.namelen] = '\0';
+
+	// message successful; copy name and push peer. if this node is already a peer, its pooled connection is kept instead
+	strcpy(peer->name, name);
+	atomic_store(&peer->lz, (frame.flags & YELL_FRAME_LZ_OK) != 0);
+
+	return yell_pushpeer(self, peer);
+}
+
+/* Reads the peers listed in a response to YET_CONNECT, and adds those that aren't known yet to candidates,
+ * which is grown as needed. Returns 1 if the responder knows of more peers than it could list, or 0. */
+int yell_readpeers(struct yell *self, const struct yell_frame *frame, struct yell_peer ***candidates, int *ncandidates, int *size) {
+	const char *fname = "yell_readpeers";
+
+	const unsigned char *entry, *end;
+	struct yell_peer    *peer, **grown;
+	struct sockaddr_in   sockaddr;
+	char                 name[NAME_SIZE + 1];
+	size_t               namelen;
+	int                  total, nlisted, port, i;
+
+	if (frame->length < CONNECT_HEADER)
+		return 0;
+
+	entry = (const unsigned char *)frame->payload;
+	end = entry + frame->length;
+
+	total = entry[0] << 8 | entry[1];
+
+	for (nlisted = 0, entry += CONNECT_HEADER; entry < end; entry += 1 + namelen + 6, ++nlisted) {
+		namelen = entry[0];
+
+		// the rest of the list is invalid
+		if (namelen == 0 || namelen > NAME_SIZE || (size_t)(end - entry) < 1 + namelen + 6)
+			break;
+
+		memcpy(name, entry + 1, namelen);
+		name[namelen] = '\0';
+
+		port = entry[1 + namelen + 4] << 8 | entry[1 + namelen + 5];
+
+		if (port == 0)
+			continue;
+
+		memset(&sockaddr, 0, sizeof(struct sockaddr_in));
+		sockaddr.sin_family = AF_INET;
+		memcpy(&sockaddr.sin_addr, entry + 1 + namelen, 4);
+		sockaddr.sin_port = htons(port);
+
+		// self, and peers that are already known or listed by another peer
+		if (strcmp(name, self->name) == 0 || yell_findpeer(self, name) != NULL || yell_findaddr(self, sockaddr) != NULL)
+			continue;
+
+		for (i = 0; i < *ncandidates && strcmp((*candidates)[i]->name, name) != 0; ++i)
+			;
+
+		if (i < *ncandidates)
+			continue;
+
+		if (*ncandidates == *size) {
+			grown = (struct yell_peer **)realloc(*candidates, sizeof(struct yell_peer *) * (*size > 0 ? 2 * *size : 16));
+
+			// memory allocation error
+			if (grown == NULL) {
+				yell_log(self, YELL_LOG_ERROR, "%s: Memory allocation error.\n", fname);
+
+				break;
+			}
+
+			*candidates = grown;
+			*size = *size > 0 ? 2 * *size : 16;
+		}
+
+		peer = yell_createpeer(self, name, sockaddr, port);
+
+		if (peer != NULL)
+			(*candidates)[(*ncandidates)++] = peer;
+	}
+
+	return nlisted < total;
+}
+
+/* Introduces self to every candidate at once with a message of type YET_WHOAREYOU or YET_CONNECT,
+ * and adds those that respond as peers; the rest are freed. With YET_CONNECT, the peers they list
+ * become the new candidates. Returns 1 if any of them knows of more peers than it could list, or 0. */
+int yell_introduce(struct yell *self, struct yell_peer ***candidates, int *ncandidates, int *size, enum yell_eventtype type) {
+	const char *fname = "yell_introduce";
+
+	struct yell_message  msg;
+	struct yell_result  *results;
+	struct pollfd       *fds;
+	struct yell_frame    frame;
+	struct yell_peer   **peers, *known;
+	char                *responses;
+	int                  npeers, truncated, i;
+
+	peers = *candidates;
+	npeers = *ncandidates;
+
+	*candidates = NULL;
+	*ncandidates = 0;
+	*size = 0;
+
+	results = (struct yell_result *)malloc(sizeof(struct yell_result) * npeers);
+	fds = (struct pollfd *)malloc(sizeof(struct pollfd) * npeers);
+	responses = (char *)malloc(FRAME_SIZE * npeers);
+
+	// memory allocation error; the candidates are given up on
+	if (results == NULL || fds == NULL || responses == NULL) {
+		yell_log(self, YELL_LOG_ERROR, "%s: Memory allocation error.\n", fname);
+
+		for (i = 0; i < npeers; ++i)
+			yell_freepeer(self, peers[i]);
+
+		free(results);
+		free(fds);
+		free(responses);
+		free(peers);
+
+		return 0;
+	}
+
+	yell_makemessage(self, &msg, type, NULL, 0);
+
+	for (i = 0; i < npeers; ++i) {
+		results[i].peer = peers[i];
+		results[i].response = responses + FRAME_SIZE * i;
+	}
+
+	// the candidates aren't peers yet, so no other thread can hold them
+	yell_fanout(self, results, fds, npeers, &msg);
+
+	for (i = 0; i < npeers; ++i) {
+		if (results[i].status == YELL_FAILURE || results[i].reply != YET_SUCCESS
+		 || yell_frame_parse(results[i].response, FRAME_SIZE, PACKET_SIZE, &frame) <= 0
+		 || frame.namelen == 0 || frame.namelen > NAME_SIZE) {
+			yell_freepeer(self, peers[i]);
+			peers[i] = NULL;
+
+			continue;
+		}
+
+		// the peer knows its own name best
+		memcpy(peers[i]->name, frame.name, frame.namelen);
+		peers[i]->name[frame.namelen] = '\0';
+		atomic_store(&peers[i]->lz, (frame.flags & YELL_FRAME_LZ_OK) != 0);
+
+		// the peer may have been added by another thread in the meantime, and its list is then left alone
+		known = yell_pushpeer(self, peers[i]);
+
+		if (known != peers[i])
+			peers[i] = NULL;
+	}
+
+	// the lists are read once every peer that responded is known, so that none of them is listed again
+	for (truncated = 0, i = 0; type == YET_CONNECT && i < npeers; ++i) {
+		if (peers[i] == NULL)
+			continue;
+
+		yell_frame_parse(results[i].response, FRAME_SIZE, PACKET_SIZE, &frame);
+
+		if (yell_readpeers(self, &frame, candidates, ncandidates, size))
+			truncated = 1;
+	}
+
+	free(results);
+	free(fds);
+	free(responses);
+	free(peers);
+
+	return truncated;
+}
+
+/* Joins the mesh of the node at addr:port, the seed, in a round trip or two: the seed responds to YET_CONNECT
+ * with its name and a list of its peers, then self is introduced to all of them at once. */
+int yell_connect(struct yell *self, const char *addr, int port) {
+	const char *fname = "yell_connect";
+
+	struct yell_peer   *seed, *known, **candidates;
+	struct sockaddr_in  sockaddr;
+	struct yell_frame   frame;
+	char                response[FRAME_SIZE];
+	int                 ncandidates, size, truncated, round, i;
+
+	memset(&sockaddr, 0, sizeof(struct sockaddr_in));
+
+	sockaddr.sin_family = AF_INET;
+	sockaddr.sin_addr.s_addr = inet_addr(addr);
+	sockaddr.sin_port = htons(port);
+
+	known = yell_findaddr(self, sockaddr);
+	seed = known != NULL ? known : yell_createpeer(self, "", sockaddr, port);
+
+	if (seed == NULL)
+		return YELL_FAILURE;
+
+	// the name of the seed is in the header of its response, as with YET_WHOAREYOU
+	if (yell_topeer(self, seed, YET_CONNECT, NULL, 0, response) == YELL_FAILURE
+	 || yell_frame_parse(response, FRAME_SIZE, PACKET_SIZE, &frame) <= 0
+	 || frame.namelen == 0 || frame.namelen > NAME_SIZE) {
+		yell_log(self, YELL_LOG_WARN, "%s: Couldn't message peer.\n", fname);
+
+		if (known == NULL)
+			yell_freepeer(self, seed);
+
+		return YELL_FAILURE;
+	}
+
+	if (known == NULL) {
+		memcpy(seed->name, frame.name, frame.namelen);
+		seed->name[frame.namelen] = '\0';
+
+		// the seed may already be a peer under another address; its pooled connection is kept instead
+		seed = yell_pushpeer(self, seed);
+
+		if (seed == NULL)
+			return YELL_FAILURE;
+	}
+
+	atomic_store(&seed->lz, (frame.flags & YELL_FRAME_LZ_OK) != 0);
+
+	candidates = NULL;
+	ncandidates = 0;
+	size = 0;
+
+	truncated = yell_readpeers(self, &frame, &candidates, &ncandidates, &size);
+
+	// if the seed couldn't list every peer, the peers it listed are asked for theirs while self is introduced to them
+	for (round = 0; round < CONNECT_ROUNDS && ncandidates > 0; ++round)
+		truncated = yell_introduce(self, &candidates, &ncandidates, &size, truncated ? YET_CONNECT : YET_WHOAREYOU);
+
+	// the rest learn of self from others
+	for (i = 0; i < ncandidates; ++i)
+		yell_freepeer(self, candidates[i]);
+
+	free(candidates);
+
+	return YELL_SUCCESS;
+}
+
+// self->fanout_mutex must be held; copies the peers to self->fanout, and returns how many there are, or -1
+int yell_snapshot(struct yell *self) {
+	const char *fname = "yell_snapshot()";
+
+	struct yell_LL_node *march;
+	struct yell_result *fanout;
+	struct pollfd *fanout_fds;
+	struct yell_peer *peer;
+	int npeers, i;
+
+	// take a snapshot of the peers, so that the listener may add peers during the fan-out
+	pthread_mutex_lock(&self->peers_mutex);
+
+	npeers = 0;
+
+	for (march = self->peers.head; march != NULL; march = march->next)
+		++npeers;
+
+	// grow the fan-out buffers to fit every peer
+	if (npeers > self->fanout_size) {
+		fanout = (struct yell_result *)realloc(self->fanout, sizeof(struct yell_result) * npeers);
+
+		if (fanout != NULL)
+			self->fanout = fanout;
+
+		fanout_fds = (struct pollfd *)realloc(self->fanout_fds, sizeof(struct pollfd) * npeers);
+
+		if (fanout_fds != NULL)
+			self->fanout_fds = fanout_fds;
+
+		// memory allocation error
+		if (fanout == NULL || fanout_fds == NULL) {
+			yell_log(self, YELL_LOG_ERROR, "%s: Memory allocation error.\n", fname);
+
+			pthread_mutex_unlock(&self->peers_mutex);
+
+			return -1;
+		}
+
+		self->fanout_size = npeers;
+	}
+
+	// peers that have failed or left are only listed until the probe thread removes them
+	for (i = 0, march = self->peers.head; march != NULL; march = march->next) {
+		peer = (struct yell_peer *)march->data;
+
+		if (atomic_load(&peer->state) >= YPS_FAILED)
+			continue;
+
+		self->fanout[i].peer = peer;
+		self->fanout[i].response = NULL;
+		++i;
+	}
+
+	pthread_mutex_unlock(&self->peers_mutex);
+
+	return i;
+}
+
+int yell_broadcast(struct yell *self, const char *message, size_t length, struct yell_result *results, int nresults) {
+	struct yell_message msg;
+	int npeers, nfailed, ncopied, i;
+
+	if (yell_makemessage(self, &msg, YET_MESSAGE, message, length) == YELL_FAILURE)
+		return -1;
+
+	// the fan-out buffers are shared by broadcasts
+	pthread_mutex_lock(&self->fanout_mutex);
+
+	npeers = yell_snapshot(self);
+
+	if (npeers < 0) {
+		pthread_mutex_unlock(&self->fanout_mutex);
+		yell_freemessage(&msg);
+
+		return -1;
+	}
+
+	// yell to every peer at once
+	yell_fanout(self, self->fanout, self->fanout_fds, npeers, &msg);
+
+	yell_freemessage(&msg);
+
+	for (nfailed = 0, i = 0; i < npeers; ++i)
+		if (self->fanout[i].status == YELL_FAILURE)
+			++nfailed;
+
+	if (results != NULL) {
+		ncopied = npeers < nresults ? npeers : nresults;
+
+		// only the outcome is copied; the rest of a result points into the message, which is gone
+		for (i = 0; i < ncopied; ++i) {
+			memset(&results[i], 0, sizeof(struct yell_result));
+
+			results[i].peer = self->fanout[i].peer;
+			results[i].status = self->fanout[i].status;
+			results[i].reply = self->fanout[i].reply;
+		}
+
+		// there are fewer peers than results; terminate the results
+		if (npeers < nresults)
+			results[npeers].peer = NULL;
+	}
+
+	pthread_mutex_unlock(&self->fanout_mutex);
+
+	return nfailed;
+}
+
+int yell(struct yell *self, const char *message) {
+	return yell_broadcast(self, message, strlen(message), NULL, 0) == 0 ? YELL_SUCCESS : YELL_FAILURE;
+}
+
+/* Sends the message to every peer as a datagram, without a connection or a response.
+ * The message may be lost, duplicated or reordered, so this suits frequent updates that supersede each other.
+ * Returns the number of peers it couldn't be sent to, or -1 if it couldn't be sent at all. */
+int yell_datagram(struct yell *self, const char *message, size_t length) {
+	const char *fname = "yell_datagram()";
+
+	struct yell_LL_node *march;
+	struct yell_peer    *peer;
+
+	struct mmsghdr    msgs[DATAGRAM_BATCH];
+	struct yell_peer *to[DATAGRAM_BATCH];
+	struct iovec      iov;
+	char              packet[DATAGRAM_SIZE];
+	int               len, nmsgs, nfailed, off, n, i;
+
+	len = yell_frame_make(packet, DATAGRAM_SIZE, YET_MESSAGE, 0, self->name, self->sockport, message, length);
+
+	// the message doesn't fit in a datagram
+	if (len < 0) {
+		yell_log(self, YELL_LOG_ERROR, "%s: Message is too long for a datagram.\n", fname);
+
+		return -1;
+	}
+
+	// every datagram shares the packet
+	iov.iov_base = packet;
+	iov.iov_len = len;
+
+	memset(msgs, 0, sizeof(msgs));
+
+	nfailed = 0;
+
+	// sending a datagram doesn't wait for the peer, so the peers are sent to in place
+	pthread_mutex_lock(&self->peers_mutex);
+
+	for (march = self->peers.head; march != NULL;) {
+		// fill a batch of datagrams; peers that have failed or left are only listed until they are removed
+		for (nmsgs = 0; march != NULL && nmsgs < DATAGRAM_BATCH; march = march->next) {
+			peer = (struct yell_peer *)march->data;
+
+			if (atomic_load(&peer->state) >= YPS_FAILED)
+				continue;
+
+			to[nmsgs] = peer;
+
+			msgs[nmsgs].msg_hdr.msg_name = &peer->sockaddr;
+			msgs[nmsgs].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+			msgs[nmsgs].msg_hdr.msg_iov = &iov;
+			msgs[nmsgs].msg_hdr.msg_iovlen = 1;
+
+			++nmsgs;
+		}
+
+		// sendmmsg() stops at the first datagram it can't send; skip it and send the rest
+		for (off = 0; off < nmsgs; off += n) {
+			n = sendmmsg(self->udpfd, msgs + off, nmsgs - off, MSG_DONTWAIT);
+
+			if (n < 0) {
+				if (errno == EINTR) {
+					n = 0;
+
+					continue;
+				}
+
+				// the send buffer is full; the datagram is dropped, as it may be anywhere on the way
+				if (errno == EAGAIN || errno == EWOULDBLOCK) {
+					yell_count(&to[off]->counters.dropped, &self->counters.dropped, 1);
+				} else {
+					yell_log(self, YELL_LOG_WARN, "%s: sendmmsg(): %s\n", fname, strerror(errno));
+
+					yell_count(&to[off]->counters.failures, &self->counters.failures, 1);
+				}
+
+				++nfailed;
+				n = 1;
+
+				continue;
+			}
+
+			for (i = off; i < off + n; ++i) {
+				yell_count(&to[i]->counters.sent, &self->counters.sent, 1);
+				yell_count(&to[i]->counters.sent_bytes, &self->counters.sent_bytes, len);
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&self->peers_mutex);
+
+	return nfailed;
+}
+
+/* Gossips the message to a random few peers, who forward it to a random few of theirs, and so on.
+ * Sending costs about log2(N) messages instead of N, but the message may take a few rounds to reach every peer.
+ * Gossip isn't split into chunks, so it must fit in a frame with the gossip header and the name of self.
+ * Returns the number of peers that couldn't be yelled to, or -1 if the message is too long or none could be picked. */
+int yell_gossip(struct yell *self, const char *message, size_t length) {
+	const char *fname = "yell_gossip()";
+
+	struct yell_message msg;
+	char                payload[PACKET_SIZE];
+	uint64_t            id;
+	size_t              namelen;
+	int                 i;
+
+	namelen = strlen(self->name);
+
+	if (length > PACKET_SIZE - GOSSIP_HEADER - namelen) {
+		yell_log(self, YELL_LOG_ERROR, "%s: Message is too long for gossip.\n", fname);
+
+		return -1;
+	}
+
+	pthread_mutex_lock(&self->gossip_mutex);
+	id = self->gossip_next++;
+	pthread_mutex_unlock(&self->gossip_mutex);
+
+	// self has already seen its own gossip
+	yell_seengossip(self, id);
+
+	for (i = 0; i < 8; ++i)
+		payload[i] = id >> (56 - 8 * i);
+
+	payload[8] = GOSSIP_TTL;
+	payload[9] = namelen;
+	payload[10] = self->sockport >> 8;
+	payload[11] = self->sockport;
+
+	// the first peer to forward the gossip knows the address of self
+	memset(payload + 12, 0, 4);
+
+	memcpy(payload + GOSSIP_HEADER, self->name, namelen);
+	memcpy(payload + GOSSIP_HEADER + namelen, message, length);
+
+	yell_makemessage(self, &msg, YET_GOSSIP, payload, GOSSIP_HEADER + namelen + length);
+
+	return yell_spreadgossip(self, &msg, NULL, NULL);
+}
+
+// window is in milliseconds; bytes is capped so that a queue that isn't yet full always has room for a frame
+void yell_setbatch(struct yell *self, int window, int bytes) {
+	self->batch_window = window;
+	self->batch_bytes = bytes < PEER_QUEUE_SIZE - FRAME_SIZE ? bytes : PEER_QUEUE_SIZE - FRAME_SIZE;
+}
+
+/* Queues a message to every peer, to be sent in one write with the other messages queued for that peer.
+ * A peer's queue is sent once batch_bytes are queued, or by the flush thread once batch_window has passed.
+ * Returns the number of peers that couldn't be yelled to while sending a queue, or -1 on failure. */
+int yell_queue(struct yell *self, const char *message, size_t length) {
+	const char *fname = "yell_queue()";
+
+	struct yell_message msg;
+	struct yell_result  result;
+	struct pollfd       fd;
+	const char         *packet;
+	char                peerstr[PEERSTR_SIZE];
+	int                 npeers, nfull, nfailed, queued, wake, len, i;
+
+	// a message larger than a frame can't be queued; it is sent after what was queued before it
+	if (length > PACKET_SIZE)
+		return yell_flush(self) < 0 ? -1 : yell_broadcast(self, message, length, NULL, 0);
 
-	// fail if couldn't open socket
-	if (self->sockfd < 0) {
-		fprintf(self->log, "%s: socket(): %s\n", fname, strerror(errno));
+	yell_makemessage(self, &msg, YET_MESSAGE, message, length);
 
-		return YELL_FAILURE;
-	}
+	// the peer doesn't respond until the end of the batch
+	yell_frame_setflags(msg.packet, YELL_FRAME_MORE);
 
-	// prepare ipv4 internet address
+	if (msg.compressed)
+		yell_frame_setflags(msg.lzpacket, YELL_FRAME_LZ | YELL_FRAME_MORE);
 
-	memset(&self->sockaddr, 0, sizeof(struct sockaddr_in));
+	pthread_mutex_lock(&self->fanout_mutex);
 
-	self->sockaddr.sin_family = AF_INET;
-	// listen to any incoming connections
-	self->sockaddr.sin_addr.s_addr = INADDR_ANY;
+	npeers = yell_snapshot(self);
 
-	// find an available port to bind with
-	for (self->sockport = MIN_PORT; self->sockport < MAX_PORT; ++self->sockport) {
-		self->sockaddr.sin_port = htons(self->sockport);
+	if (npeers < 0) {
+		pthread_mutex_unlock(&self->fanout_mutex);
 
-		// attempt to bind
-		if (bind(self->sockfd, (struct sockaddr *)&self->sockaddr,
-		                       sizeof(struct sockaddr_in)) == 0)
-			// break loop on success
-			break;
+		return -1;
 	}
 
-	// couldn't find an available port
-	if (self->sockport == MAX_PORT) {
-		fprintf(self->log, "%s: bind(): %s\n", fname, strerror(errno));
+	nfailed = 0;
+	wake = 0;
 
-		// close the socket
-		close(self->sockfd);
+	// peers whose queue is full are moved to the front of the snapshot
+	for (nfull = 0, i = 0; i < npeers; ++i) {
+		result = self->fanout[i];
 
-		return YELL_FAILURE;
-	}
+		// a peer that accepts compressed frames is queued the compressed message
+		if (msg.compressed && atomic_load(&result.peer->lz)) {
+			packet = msg.lzpacket;
+			len = msg.lz.iov_len;
+		} else {
+			packet = msg.packet;
+			len = msg.small.iov_len;
+		}
 
-	// attempt to start listening for connections
-	if (listen(self->sockfd, MAX_CONNECTIONS) < 0) {
-		fprintf(self->log, "%s: listen(): %s\n", fname, strerror(errno));
+		queued = yell_queuepacket(result.peer, packet, len);
 
-		// close the socket
-		close(self->sockfd);
+		// another thread filled the queue; send it, then queue again
+		if (queued < 0) {
+			yell_fanout(self, &result, &fd, 1, NULL);
 
-		return YELL_FAILURE;
-	}
+			if (result.status == YELL_FAILURE)
+				++nfailed;
 
-	// socket is prepared; initialize data
+			queued = yell_queuepacket(result.peer, packet, len);
+		}
 
-	self->close = 0;
-	pthread_mutex_init(&self->close_mutex, NULL);
+		if (queued < 0) {
+			yell_log(self, YELL_LOG_WARN, "yell_queue: %s: Queue is full; dropping message.\n", yell_peerstr(peerstr, result.peer->name, result.peer->sockaddr));
 
-	// set event handler
-	if (event_handler == NULL)
-		self->event_handler = yell_pushevent;
-	else
-		self->event_handler = event_handler;
+			++nfailed;
 
-	// attempt to open listen thread
-	if (pthread_create(&self->listen_thread, NULL,
-	                   yell_listen, (void *)self) < 0) {
-		fprintf(self->log, "%s: pthread_create(): %s\n", fname, strerror(errno));
+			continue;
+		}
 
-		// close the socket
-		close(self->sockfd);
+		// the queue was empty; its window starts now
+		if (queued == len)
+			wake = 1;
 
-		return YELL_FAILURE;
+		if (queued >= self->batch_bytes)
+			self->fanout[nfull++] = result;
 	}
 
-	// initialize events linked list
-	self->events.head = NULL;
-	pthread_mutex_init(&self->events_mutex, NULL);
+	if (nfull > 0) {
+		yell_fanout(self, self->fanout, self->fanout_fds, nfull, NULL);
 
-	// initialize peers linked list
-	self->peers.head = NULL;
-	pthread_mutex_init(&self->peers_mutex, NULL);
+		for (i = 0; i < nfull; ++i)
+			if (self->fanout[i].status == YELL_FAILURE)
+				++nfailed;
+	}
 
-	return YELL_SUCCESS;
+	pthread_mutex_unlock(&self->fanout_mutex);
+
+	// let the flush thread know when to send the new queues
+	if (wake && eventfd_write(self->flush_fd, 1) < 0)
+		yell_log(self, YELL_LOG_ERROR, "%s: eventfd_write(): %s\n", fname, strerror(errno));
+
+	return nfailed;
 }
 
-struct yell_peer *yell_addpeer(struct yell *self, const char *addr, int port) {
-	const char *fname = "yell_addpeer";
+// sends every peer the messages queued for it now; returns the number of peers that couldn't be yelled to, or -1
+int yell_flush(struct yell *self) {
+	int npeers, nfailed, i;
 
-	struct yell_peer *peer;
-	char name[NAME_SIZE + 1];
+	pthread_mutex_lock(&self->fanout_mutex);
 
-	peer = (struct yell_peer *)malloc(sizeof(struct yell_peer));
+	npeers = yell_snapshot(self);
 
-	// memory allocation error
-	if (peer == NULL) {
-		fprintf(self->log, "%s: Memory allocation error.\n", fname);
+	if (npeers < 0) {
+		pthread_mutex_unlock(&self->fanout_mutex);
 
-		return NULL;
+		return -1;
 	}
 
-	memset(&peer->sockaddr, 0, sizeof(addr));
+	yell_fanout(self, self->fanout, self->fanout_fds, npeers, NULL);
+
+	for (nfailed = 0, i = 0; i < npeers; ++i)
+		if (self->fanout[i].status == YELL_FAILURE)
+			++nfailed;
 
-	peer->sockaddr.sin_family = AF_INET;
-	peer->sockaddr.sin_addr.s_addr = inet_addr(addr);
-	peer->sockaddr.sin_port = htons(port);
-	peer->sockport = port;
+	pthread_mutex_unlock(&self->fanout_mutex);
 
-	// receive node's name
-	if (yell_topeer(self, peer, YET_WHOAREYOU, NULL, name) == YELL_FAILURE) {
-		fprintf(self->log, "%s: Couldn't message peer.\n", fname);
+	return nfailed;
+}
 
-		free(peer);
+/* Submits a message to be sent to the peer, or to every peer if peer is NULL, without waiting on the network.
+ * Once every peer has responded or failed, done is called from a sender thread with the completion;
+ * without done, the completion is queued for yell_nextcompletion() instead.
+ * Messages to a peer are sent in the order they were submitted. */
+int yell_submit(struct yell *self, struct yell_peer *peer, const char *message, size_t length, void (*done)(struct yell *, const struct yell_completion *), void *arg) {
+	const char *fname = "yell_submit()";
 
-		return NULL;
+	struct yell_LL_node *march;
+	struct yell_submit  *submit;
+	struct yell_job      job;
+	int                  npeers;
+
+	submit = (struct yell_submit *)yell_MP_alloc(&self->submit_pool);
+
+	// memory allocation error
+	if (submit == NULL) {
+		yell_log(self, YELL_LOG_ERROR, "%s: Memory allocation error.\n", fname);
+
+		return YELL_FAILURE;
 	}
 
-	// message successful; copy name and push peer
-	strncpy(peer->name, name, NAME_SIZE);
-	peer->name[strlen(name)] = '\0';
-	yell_pushpeer(self, peer);
+	// a large message is sent from a copy, since the caller may reuse its buffer right away
+	submit->copy = NULL;
 
-	return peer;
-}
+	if (length > PACKET_SIZE) {
+		submit->copy = (char *)malloc(length);
 
-int yell_connect(struct yell *self, const char *addr, int port) {
-	const char *fname = "yell_connect";
+		if (submit->copy == NULL) {
+			yell_log(self, YELL_LOG_ERROR, "%s: Memory allocation error.\n", fname);
 
-	struct yell_peer *peer;
-	char peers[PACKET_SIZE + 1],
-	     addrstr[INET_ADDRSTRLEN];
-	int i, j,
-	    sockport;
+			yell_MP_release(&self->submit_pool, submit);
 
-	// get the first peer
-	peer = yell_addpeer(self, addr, port);
+			return YELL_FAILURE;
+		}
+
+		memcpy(submit->copy, message, length);
+		message = submit->copy;
+	}
 
-	// receive information about other peers
-	if (yell_topeer(self, peer, YET_CONNECT, NULL, peers) == YELL_FAILURE) {
-		fprintf(self->log, "%s: Couldn't message peer.\n", fname);
+	if (yell_makemessage(self, &submit->message, YET_MESSAGE, message, length) == YELL_FAILURE) {
+		free(submit->copy);
+		yell_MP_release(&self->submit_pool, submit);
 
 		return YELL_FAILURE;
 	}
 
-	// add other peers
-	for (i = 0; peers[i] != '\0';) {
-		// get address
-		for (j = 0; peers[i] != ':' && peers[i] != '\0'; ++i, ++j)
-			addrstr[j] = peers[i];
-
-		addrstr[j] = '\0';
+	submit->done = done;
+	submit->completion.arg = arg;
+	submit->completion.peer = peer;
 
-		if (peers[i] == '\0')
-			break;
+	// this holds the submission open until every job has been given out
+	atomic_init(&submit->remaining, 1);
+	atomic_init(&submit->nfailed, 0);
 
-		// get port
-		if (sscanf(peers + i + 1, "%d", &sockport) <= 0) {
-			while (peers[i] != ';' && peers[i] != '\0')
-				++i;
+	job.submit = submit;
 
-			continue;
-		}
+	if (peer != NULL) {
+		job.peer = peer;
+		yell_pushjob(self, &job);
 
-		printf("%s:%d\n", addrstr, sockport);
+		npeers = 1;
+	} else {
+		pthread_mutex_lock(&self->peers_mutex);
 
-		yell_addpeer(self, addrstr, sockport);
+		// peers that have failed or left would only hold a sender up until they time out
+		for (npeers = 0, march = self->peers.head; march != NULL; march = march->next) {
+			job.peer = (struct yell_peer *)march->data;
 
-		// go to the end of this entry
-		while (peers[i] != ';' && peers[i] != '\0')
-			++i;
+			if (atomic_load(&job.peer->state) >= YPS_FAILED)
+				continue;
 
-		if (peers[i] == '\0')
-			break;
+			yell_pushjob(self, &job);
+			++npeers;
+		}
 
-		++i;
+		pthread_mutex_unlock(&self->peers_mutex);
 	}
 
+	submit->completion.npeers = npeers;
+
+	// the submission completes here if every job is already done
+	yell_finishjob(self, submit, 0);
+
 	return YELL_SUCCESS;
 }
 
-int yell(struct yell *self, const char *message) {
-	struct yell_LL_node *march;
+// takes the next queued completion; fails if there is none. completion_fd is readable while there may be more
+int yell_nextcompletion(struct yell *self, struct yell_completion *completion) {
+	eventfd_t count;
 
-	pthread_mutex_lock(&self->peers_mutex);
+	if (yell_RB_pop(&self->completions, completion) == YELL_RB_SUCCESS)
+		return YELL_SUCCESS;
 
-	// for every connected peer..
-	for (march = self->peers.head; march != NULL; march = march->next)
-		// ...yell the message to that peer
-		yell_topeer(self, (struct yell_peer *)march->data, YET_MESSAGE, message, NULL);
+	// the queue is empty; clear the notification, then check again, like yell_nextevent()
+	eventfd_read(self->completion_fd, &count);
 
-	pthread_mutex_unlock(&self->peers_mutex);
+	if (yell_RB_pop(&self->completions, completion) == YELL_RB_FAILURE)
+		return YELL_FAILURE;
+
+	eventfd_write(self->completion_fd, 1);
 
 	return YELL_SUCCESS;
 }
 
+int yell_completionfd(struct yell *self) {
+	return self->completion_fd;
+}
+
 void yell_exit(struct yell *self) {
 	const char *fname = "yell_exit()";
 
+	struct yell_message msg;
 	struct yell_event *event;
 	struct yell_peer *peer;
+	int npeers, i;
+
+	// send what is left in the queues, and wait for submitted messages to be sent
+	yell_flush(self);
+	yell_stopworkers(self->senders, SEND_WORKERS);
+
+	// tell the peers that self is leaving, so that they don't have to find out that it failed
+	yell_makemessage(self, &msg, YET_DISCONNECT, NULL, 0);
+
+	pthread_mutex_lock(&self->fanout_mutex);
+
+	npeers = yell_snapshot(self);
+
+	if (npeers > 0)
+		yell_fanoutwithin(self, self->fanout, self->fanout_fds, npeers, &msg, PROBE_TIMEOUT);
+
+	pthread_mutex_unlock(&self->fanout_mutex);
 
 	pthread_mutex_lock(&self->close_mutex);
 
@@ -651,24 +3954,73 @@ void yell_exit(struct yell *self) {
 
 	pthread_mutex_unlock(&self->close_mutex);
 
-	// shutdown and close the socket
-	shutdown(self->sockfd, SHUT_RD);
-	close(self->sockfd);
+	// wake the listen thread, then join it
+	if (eventfd_write(self->wakefd, 1) < 0)
+		yell_log(self, YELL_LOG_ERROR, "%s: eventfd_write(): %s\n", fname, strerror(errno));
 
-	// join the listen thread
 	pthread_join(self->listen_thread, NULL);
 
+	// the listener dispatches no more events; the workers handle what is left
+	yell_stopworkers(self->workers, EVENT_WORKERS);
+
+	// the listener queues no more gossip; the gossip thread drops what is left
+	if (eventfd_write(self->gossip_fd, 1) < 0)
+		yell_log(self, YELL_LOG_ERROR, "%s: eventfd_write(): %s\n", fname, strerror(errno));
+
+	pthread_join(self->gossip_thread, NULL);
+
+	if (eventfd_write(self->flush_fd, 1) < 0)
+		yell_log(self, YELL_LOG_ERROR, "%s: eventfd_write(): %s\n", fname, strerror(errno));
+
+	pthread_join(self->flush_thread, NULL);
+
+	if (eventfd_write(self->probe_fd, 1) < 0)
+		yell_log(self, YELL_LOG_ERROR, "%s: eventfd_write(): %s\n", fname, strerror(errno));
+
+	pthread_join(self->probe_thread, NULL);
+
+	// close the sockets, along with the epoll set and the eventfds
+	yell_closefds(self);
+
 	pthread_mutex_destroy(&self->close_mutex);
-	pthread_mutex_destroy(&self->events_mutex);
 	pthread_mutex_destroy(&self->peers_mutex);
+	pthread_mutex_destroy(&self->fanout_mutex);
+	pthread_mutex_destroy(&self->gossip_mutex);
+	pthread_mutex_destroy(&self->members_mutex);
 
-	while ((event = yell_LL_remove(&self->events, YELL_LL_HEAD)) != NULL)
-		free(event);
+	free(self->fanout);
+	free(self->fanout_fds);
+
+	// the eventfds are closed, so the events left are popped directly rather than through yell_nextevent()
+	while (yell_RB_pop(&self->events, &event) == YELL_RB_SUCCESS)
+		yell_freeevent(self, event);
+
+	yell_RB_free(&self->events);
+	yell_RB_free(&self->completions);
+
+	// closes the pooled connection of each peer
+	while ((peer = yell_LL_remove(&self->peers, YELL_LL_HEAD)) != NULL)
+		yell_freepeer(self, peer);
+
+	while ((peer = yell_LL_remove(&self->graveyard, YELL_LL_HEAD)) != NULL)
+		yell_freepeer(self, peer);
+
+	yell_HT_free(&self->peers_byname);
+	yell_HT_free(&self->peers_byaddr);
+	yell_HT_free(&self->gossip_seen);
+	yell_RB_free(&self->gossip);
+	yell_RB_free(&self->probes);
 
-	while ((peer = yell_LL_remove(&self->events, YELL_LL_HEAD)) != NULL)
-		free(peer);
+	// events still held by the application are freed along with their pools
+	for (i = 0; i < EVENT_CLASSES; ++i)
+		yell_MP_free(&self->event_pools[i]);
 
-	fprintf(self->log, "%s: Exited.\n", fname);
+	yell_MP_free(&self->peer_pool);
+	yell_MP_free(&self->submit_pool);
+
+	yell_log(self, YELL_LOG_INFO, "%s: Exited.\n", fname);
+
+	yell_stoplog(self);
 }
 
 void yell_peerf(FILE *file, const char *format, const char *name, struct sockaddr_in sockaddr) {
@@ -755,10 +4107,387 @@ void yell_debugf(FILE *file, struct yell *self) {
 void yell_logf(FILE *file, struct yell *self) {
 	int c;
 
+	// write out what is waiting for the log thread first
+	yell_flushlog(self);
+
+	pthread_mutex_lock(&self->log_mutex);
+
 	fseek(self->log, 0, SEEK_SET);
 
 	c = getc(self->log);
 
 	for (; c != EOF; c = getc(self->log))
 		putc(c, file);
+
+	// the log is appended to after reading it
+	fseek(self->log, 0, SEEK_END);
+
+	pthread_mutex_unlock(&self->log_mutex);
+}
+
+// formats a line of the log; called through yell_log(), which compiles out lines above YELL_LOG_LEVEL
+void yell_logmsg(struct yell *self, int level, const char *format, ...) {
+	struct yell_logline line;
+	va_list args;
+	int length;
+
+	va_start(args, format);
+	length = vsnprintf(line.text, LOG_LINE_SIZE, format, args);
+	va_end(args);
+
+	if (length < 0)
+		return;
+
+	// a line too long for the record is cut short, but still ends the line
+	if (length >= LOG_LINE_SIZE) {
+		length = LOG_LINE_SIZE - 1;
+		line.text[length - 1] = '\n';
+	}
+
+	line.length = length;
+
+	// the log thread writes the line out later, so that logging costs no I/O
+	if (atomic_load_explicit(&self->log_async, memory_order_acquire)) {
+		if (yell_RB_push(&self->logs, &line) == YELL_RB_FAILURE)
+			atomic_fetch_add_explicit(&self->log_dropped, 1, memory_order_relaxed);
+		else if (level == YELL_LOG_ERROR)
+			eventfd_write(self->log_fd, 1);
+
+		return;
+	}
+
+	pthread_mutex_lock(&self->log_mutex);
+	yell_writelog(self, line.text, line.length);
+	fflush(self->log);
+	pthread_mutex_unlock(&self->log_mutex);
+}
+
+// self->log_mutex must be held
+void yell_writelog(struct yell *self, const char *text, size_t length) {
+	long size;
+
+	if (self->log == NULL)
+		return;
+
+	// the temporary file is emptied rather than grown past LOG_FILE_SIZE
+	if (self->log_owned && (size = ftell(self->log)) >= 0 && (size_t)size + length > LOG_FILE_SIZE) {
+		fflush(self->log);
+
+		if (ftruncate(fileno(self->log), 0) == 0) {
+			rewind(self->log);
+			fputs("yell_writelog(): Log was emptied.\n", self->log);
+		}
+	}
+
+	fwrite(text, 1, length, self->log);
+}
+
+// writes out the lines waiting for the log thread; any thread may call this
+void yell_flushlog(struct yell *self) {
+	struct yell_logline line;
+	char dropped[LOG_LINE_SIZE];
+	uint64_t ndropped;
+	int nlines, length;
+
+	if (!atomic_load_explicit(&self->log_async, memory_order_acquire))
+		return;
+
+	pthread_mutex_lock(&self->log_mutex);
+
+	for (nlines = 0; yell_RB_pop(&self->logs, &line) == YELL_RB_SUCCESS; ++nlines)
+		yell_writelog(self, line.text, line.length);
+
+	ndropped = atomic_exchange_explicit(&self->log_dropped, 0, memory_order_relaxed);
+
+	if (ndropped > 0) {
+		length = snprintf(dropped, sizeof(dropped), "yell_flushlog(): %" PRIu64 " lines dropped.\n", ndropped);
+		yell_writelog(self, dropped, length);
+
+		++nlines;
+	}
+
+	if (nlines > 0)
+		fflush(self->log);
+
+	pthread_mutex_unlock(&self->log_mutex);
+}
+
+void *yell_writelogs(void *self_ptr) {
+	struct yell *self = (struct yell *)self_ptr;
+	struct pollfd fd;
+	eventfd_t count;
+
+	fd.fd = self->log_fd;
+	fd.events = POLLIN;
+
+	for (;;) {
+		// woken early for errors, and to exit
+		poll(&fd, 1, LOG_FLUSH_INTERVAL);
+		eventfd_read(self->log_fd, &count);
+
+		yell_flushlog(self);
+
+		if (atomic_load(&self->log_close))
+			break;
+	}
+
+	return NULL;
+}
+
+// starts the log thread; if it can't be started, the log is written out by whoever logs
+void yell_startlog(struct yell *self) {
+	const char *fname = "yell_startlog()";
+
+	if (yell_RB_init(&self->logs, LOG_QUEUE_SIZE, sizeof(struct yell_logline)) == YELL_RB_FAILURE) {
+		yell_log(self, YELL_LOG_ERROR, "%s: Memory allocation error.\n", fname);
+
+		return;
+	}
+
+	atomic_init(&self->log_close, 0);
+	self->log_fd = eventfd(0, EFD_NONBLOCK);
+
+	if (self->log_fd < 0) {
+		yell_log(self, YELL_LOG_ERROR, "%s: eventfd(): %s\n", fname, strerror(errno));
+
+		yell_RB_free(&self->logs);
+
+		return;
+	}
+
+	if (pthread_create(&self->log_thread, NULL, yell_writelogs, (void *)self) != 0) {
+		yell_log(self, YELL_LOG_ERROR, "%s: pthread_create(): %s\n", fname, strerror(errno));
+
+		yell_RB_free(&self->logs);
+		close(self->log_fd);
+
+		return;
+	}
+
+	atomic_store_explicit(&self->log_async, 1, memory_order_release);
+}
+
+// every other thread of self must have stopped; the lines still waiting are written out, and a temporary log is closed
+void yell_stoplog(struct yell *self) {
+	if (atomic_load(&self->log_async)) {
+		atomic_store(&self->log_close, 1);
+		eventfd_write(self->log_fd, 1);
+		pthread_join(self->log_thread, NULL);
+
+		// the log thread may have been between its last flush and seeing log_close
+		yell_flushlog(self);
+
+		atomic_store(&self->log_async, 0);
+
+		yell_RB_free(&self->logs);
+		close(self->log_fd);
+	}
+
+	if (self->log_owned && self->log != NULL) {
+		fclose(self->log);
+		self->log = NULL;
+	}
+
+	pthread_mutex_destroy(&self->log_mutex);
+}
+
+// writes name@address:port into buf, which has room for PEERSTR_SIZE; returns buf
+const char *yell_peerstr(char *buf, const char *name, struct sockaddr_in sockaddr) {
+	char addr[INET_ADDRSTRLEN];
+
+	if (sockaddr.sin_addr.s_addr == INADDR_ANY)
+		strcpy(addr, "127.0.0.1");
+	else
+		inet_ntop(sockaddr.sin_family, &sockaddr.sin_addr, addr, INET_ADDRSTRLEN);
+
+	snprintf(buf, PEERSTR_SIZE, "%s@%s:%d", name, addr, ntohs(sockaddr.sin_port));
+
+	return buf;
+}
+
+// adds n to the counter of a peer and to the total of self; counters are only read by yell_stats()
+void yell_count(_Atomic uint64_t *counter, _Atomic uint64_t *total, uint64_t n) {
+	atomic_fetch_add_explicit(counter, n, memory_order_relaxed);
+	atomic_fetch_add_explicit(total, n, memory_order_relaxed);
+}
+
+// records a round trip to the peer, in microseconds
+void yell_countrtt(struct yell *self, struct yell_peer *peer, uint64_t rtt) {
+	uint64_t max;
+
+	yell_HG_record(&self->rtt, rtt);
+
+	atomic_fetch_add_explicit(&peer->rtt_count, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&peer->rtt_sum, rtt, memory_order_relaxed);
+
+	max = atomic_load_explicit(&peer->rtt_max, memory_order_relaxed);
+
+	while (rtt > max && !atomic_compare_exchange_weak_explicit(&peer->rtt_max, &max, rtt, memory_order_relaxed, memory_order_relaxed))
+		;
+}
+
+void yell_readcounters(struct yell_counters *counters, struct yell_atomiccounters *from) {
+	counters->sent = atomic_load_explicit(&from->sent, memory_order_relaxed);
+	counters->sent_bytes = atomic_load_explicit(&from->sent_bytes, memory_order_relaxed);
+	counters->received = atomic_load_explicit(&from->received, memory_order_relaxed);
+	counters->received_bytes = atomic_load_explicit(&from->received_bytes, memory_order_relaxed);
+	counters->failures = atomic_load_explicit(&from->failures, memory_order_relaxed);
+	counters->reconnects = atomic_load_explicit(&from->reconnects, memory_order_relaxed);
+	counters->dropped = atomic_load_explicit(&from->dropped, memory_order_relaxed);
+}
+
+/* Takes a snapshot of the statistics of self; the counters are read without stopping other threads,
+ * so they may be a little apart from each other. stats->peers is freed by yell_freestats(). */
+int yell_stats(struct yell *self, struct yell_stats *stats) {
+	const char *fname = "yell_stats()";
+
+	struct yell_LL_node   *march;
+	struct yell_peer      *peer;
+	struct yell_peerstats *peerstats;
+	size_t nslabs, nfree;
+	int i;
+
+	memset(stats, 0, sizeof(*stats));
+
+	yell_readcounters(&stats->counters, &self->counters);
+
+	stats->events = yell_RB_count(&self->events);
+	stats->gossip = yell_RB_count(&self->gossip);
+	stats->probes = yell_RB_count(&self->probes);
+	stats->completions = yell_RB_count(&self->completions);
+
+	for (i = 0; i < EVENT_WORKERS; ++i)
+		stats->work += yell_RB_count(&self->workers[i].queue);
+
+	for (i = 0; i < SEND_WORKERS; ++i)
+		stats->jobs += yell_RB_count(&self->senders[i].queue);
+
+	for (i = 0; i < EVENT_CLASSES; ++i) {
+		yell_MP_count(&self->event_pools[i], &nslabs, &nfree);
+
+		stats->event_slabs += nslabs;
+		stats->event_free += nfree;
+	}
+
+	yell_MP_count(&self->peer_pool, &stats->peer_slabs, &stats->peer_free);
+	yell_MP_count(&self->submit_pool, &stats->submit_slabs, &stats->submit_free);
+
+	yell_HG_copy(&stats->rtt, &self->rtt);
+	yell_HG_copy(&stats->probe_rtt, &self->probe_rtt);
+
+	pthread_mutex_lock(&self->peers_mutex);
+
+	for (march = self->peers.head; march != NULL; march = march->next)
+		++stats->npeers;
+
+	if (stats->npeers > 0) {
+		stats->peers = (struct yell_peerstats *)malloc(stats->npeers * sizeof(struct yell_peerstats));
+
+		// memory allocation error
+		if (stats->peers == NULL) {
+			pthread_mutex_unlock(&self->peers_mutex);
+
+			yell_log(self, YELL_LOG_ERROR, "%s: Memory allocation error.\n", fname);
+
+			stats->npeers = 0;
+
+			return YELL_FAILURE;
+		}
+	}
+
+	for (i = 0, march = self->peers.head; march != NULL; march = march->next, ++i) {
+		peer = (struct yell_peer *)march->data;
+		peerstats = &stats->peers[i];
+
+		strcpy(peerstats->name, peer->name);
+		peerstats->sockaddr = peer->sockaddr;
+		peerstats->state = atomic_load(&peer->state);
+
+		yell_readcounters(&peerstats->counters, &peer->counters);
+
+		pthread_mutex_lock(&peer->queue_mutex);
+		peerstats->queued = peer->queuelen;
+		pthread_mutex_unlock(&peer->queue_mutex);
+
+		peerstats->rtt_count = atomic_load_explicit(&peer->rtt_count, memory_order_relaxed);
+		peerstats->rtt_mean = peerstats->rtt_count > 0
+		                    ? atomic_load_explicit(&peer->rtt_sum, memory_order_relaxed) / peerstats->rtt_count : 0;
+		peerstats->rtt_max = atomic_load_explicit(&peer->rtt_max, memory_order_relaxed);
+	}
+
+	pthread_mutex_unlock(&self->peers_mutex);
+
+	return YELL_SUCCESS;
+}
+
+void yell_freestats(struct yell_stats *stats) {
+	free(stats->peers);
+
+	stats->peers = NULL;
+	stats->npeers = 0;
+}
+
+void yell_statsf(FILE *file, struct yell *self) {
+	static const char *states[] = { "alive", "suspect", "failed", "left" };
+
+	struct yell_stats      stats;
+	struct yell_peerstats *peerstats;
+	int i;
+
+	if (yell_stats(self, &stats) == YELL_FAILURE)
+		return;
+
+	fprintf(file, "--- begin yell stats ---\n");
+
+	fprintf(file, "Self is:\n");
+	yell_peerf(file, "\t$n@$a:$p\n", self->name, self->sockaddr);
+
+	fprintf(file, "Totals:\n");
+	fprintf(file, "\tsent %" PRIu64 " messages, %" PRIu64 " bytes\n", stats.counters.sent, stats.counters.sent_bytes);
+	fprintf(file, "\treceived %" PRIu64 " messages, %" PRIu64 " bytes\n", stats.counters.received, stats.counters.received_bytes);
+	fprintf(file, "\t%" PRIu64 " failures, %" PRIu64 " reconnects, %" PRIu64 " datagrams dropped\n",
+	        stats.counters.failures, stats.counters.reconnects, stats.counters.dropped);
+
+	fprintf(file, "Queues:\n");
+	fprintf(file, "\t%zu events, %zu work, %zu jobs, %zu gossip, %zu probes, %zu completions\n",
+	        stats.events, stats.work, stats.jobs, stats.gossip, stats.probes, stats.completions);
+
+	fprintf(file, "Pools (free/slabs):\n");
+	fprintf(file, "\tevents %zu/%zu, peers %zu/%zu, submits %zu/%zu\n",
+	        stats.event_free, stats.event_slabs, stats.peer_free, stats.peer_slabs, stats.submit_free, stats.submit_slabs);
+
+	fprintf(file, "Round trips (us):\n");
+	fprintf(file, "\t%" PRIu64 " samples, p50 %" PRIu64 ", p90 %" PRIu64 ", p99 %" PRIu64 ", p99.9 %" PRIu64 ", max %" PRIu64 "\n",
+	        atomic_load(&stats.rtt.total),
+	        yell_HG_percentile(&stats.rtt, 50), yell_HG_percentile(&stats.rtt, 90),
+	        yell_HG_percentile(&stats.rtt, 99), yell_HG_percentile(&stats.rtt, 99.9),
+	        atomic_load(&stats.rtt.max));
+
+	fprintf(file, "Probe round trips (us):\n");
+	fprintf(file, "\t%" PRIu64 " samples, p50 %" PRIu64 ", p90 %" PRIu64 ", p99 %" PRIu64 ", p99.9 %" PRIu64 ", max %" PRIu64 "\n",
+	        atomic_load(&stats.probe_rtt.total),
+	        yell_HG_percentile(&stats.probe_rtt, 50), yell_HG_percentile(&stats.probe_rtt, 90),
+	        yell_HG_percentile(&stats.probe_rtt, 99), yell_HG_percentile(&stats.probe_rtt, 99.9),
+	        atomic_load(&stats.probe_rtt.max));
+
+	fprintf(file, "Peers:\n");
+
+	for (i = 0; i < stats.npeers; ++i) {
+		peerstats = &stats.peers[i];
+
+		yell_peerf(file, "\t$n@$a:$p", peerstats->name, peerstats->sockaddr);
+		fprintf(file, " (%s): sent %" PRIu64 "/%" PRIu64 "B, received %" PRIu64 "/%" PRIu64 "B, "
+		              "%" PRIu64 " failures, %" PRIu64 " reconnects, %d queued, rtt mean %" PRIu64 " max %" PRIu64 " us\n",
+		        states[peerstats->state],
+		        peerstats->counters.sent, peerstats->counters.sent_bytes,
+		        peerstats->counters.received, peerstats->counters.received_bytes,
+		        peerstats->counters.failures, peerstats->counters.reconnects,
+		        peerstats->queued, peerstats->rtt_mean, peerstats->rtt_max);
+	}
+
+	fprintf(file, "\t... %d peers.\n", stats.npeers);
+
+	fprintf(file, "--- end yell stats ---\n");
+
+	yell_freestats(&stats);
 }
@@ -6,10 +6,23 @@
 #ifndef YELL_H
 #define YELL_H
 
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+
 #include <netinet/in.h>
+#include <sys/uio.h>
+#include <poll.h>
 #include <pthread.h>
 
 #include "yell_LL.h"
+#include "yell_HT.h"
+#include "yell_RB.h"
+#include "yell_MP.h"
+#include "yell_frame.h"
+#include "yell_LZ.h"
+#include "yell_HG.h"
 
 #define YELL_SUCCESS  0
 #define YELL_FAILURE  1
@@ -17,13 +30,168 @@
 #define MIN_PORT  5000
 #define MAX_PORT  5100
 
+// the backlog of the listening socket
 #define MAX_CONNECTIONS  100
 
+/* Connections from peers stay open for reuse, so a node holds one for each peer that talks to it.
+ * Past this many, the connection idle the longest is closed to make room for a new one. */
+#ifndef MAX_PEER_CONNECTIONS
+#define MAX_PEER_CONNECTIONS  4096
+#endif
+
 #define NAME_SIZE  64
 
 // each packet holds maximum one kilobyte
 #define PACKET_SIZE  1024
 
+// a packet on the wire, with its header and the name of its sender
+#define FRAME_SIZE  (YELL_FRAME_HEADER + NAME_SIZE + PACKET_SIZE)
+
+// larger messages are split into frames of PACKET_SIZE; this is the largest a peer may send
+#define MESSAGE_SIZE  (64 * 1024 * 1024)
+
+// the most pieces of a message given to one sendmsg()
+#define SEND_IOVS  256
+
+// pooled peer connections unused for this many seconds are closed
+#define IDLE_TIMEOUT  30
+
+// milliseconds a peer has to connect and respond before it has failed
+#define PEER_TIMEOUT  5000
+
+// milliseconds between attempts of a fan-out to lock a peer that another thread is sending to
+#define FANOUT_RETRY  2
+
+// events not yet handled by the application; more than this are dropped
+#define EVENT_QUEUE_SIZE  1024
+
+// events are pooled by payload size, so that a ping doesn't take a kilobyte
+#define EVENT_CLASSES    3
+#define EVENT_SLAB_SIZE  64
+#define PEER_SLAB_SIZE   16
+
+// room for several frames on a connection
+#define CONN_BUFFER_SIZE  (4 * FRAME_SIZE)
+
+// messages queued for a peer are sent together, once the first has waited BATCH_WINDOW milliseconds
+// or BATCH_BYTES are queued, whichever comes first
+#define PEER_QUEUE_SIZE  (4 * FRAME_SIZE)
+#define BATCH_WINDOW     5
+#define BATCH_BYTES      (PEER_QUEUE_SIZE / 2)
+
+// events are handled by this many threads; events from a peer are always handled by the same one
+#ifndef EVENT_WORKERS
+#define EVENT_WORKERS  4
+#endif
+
+// messages submitted with yell_submit() are sent by this many threads; each peer is always sent to by the same one
+#define SEND_WORKERS     4
+#define SEND_QUEUE_SIZE  1024
+
+// completions not yet taken by the application; more than this are dropped
+#define COMPLETION_QUEUE_SIZE  1024
+#define SUBMIT_SLAB_SIZE       16
+
+// a datagram holds one whole frame, and must fit in a packet on the network without fragmenting
+#define DATAGRAM_SIZE   1200
+#define DATAGRAM_BATCH  32
+
+/* The socket buffers of the datagram socket hold this many bytes of batches,
+ * so that a burst from several peers waits for the listener instead of being dropped.
+ * The system may cap it; on Linux, at net.core.rmem_max and wmem_max. */
+#ifndef DATAGRAM_BUFFER
+#define DATAGRAM_BUFFER  (64 * DATAGRAM_BATCH * DATAGRAM_SIZE)
+#endif
+
+/* A batch isn't read until the event queues have room for it, so that they drain into the handler first;
+ * the listener waits for at most this many milliseconds, after which what doesn't fit is dropped. */
+#ifndef DATAGRAM_WAIT
+#define DATAGRAM_WAIT  50
+#endif
+
+// gossip is forwarded to about log2(N) + 1 peers at a time, for a number of rounds
+#define GOSSIP_MAX_FANOUT  16
+#define GOSSIP_TTL         8
+
+// gossip seen by a node, remembered so that it is delivered and forwarded once
+#define GOSSIP_HISTORY  4096
+
+// gossip not yet forwarded; more than this are delivered but not forwarded
+#define GOSSIP_QUEUE_SIZE  256
+
+/* The payload of gossip starts with a header, in network byte order:
+ *   id (8), time to live (1), origin name length (1), origin port (2), origin address (4)
+ * followed by the name of the origin, then the message. */
+#define GOSSIP_HEADER  16
+
+/* The response to YET_CONNECT lists the other peers of the responder, in network byte order:
+ *   number of peers (2)
+ * followed by as many of them as fit, each of which is:
+ *   name length (1), name, address (4), port (2) */
+#define CONNECT_HEADER  2
+
+// a joining node asks the peers it is introduced to for more peers this many times at most
+#define CONNECT_ROUNDS  3
+
+/* Each period, one peer is probed with YET_PROBE; if it doesn't respond in time, a few others are asked to
+ * probe it with YET_PROBEREQ, and it is suspected unless one of them acknowledges it with YET_PROBEACK
+ * by the next period. A peer that doesn't refute the suspicion in time has failed. Times are in milliseconds. */
+#define PROBE_PERIOD     1000
+#define PROBE_TIMEOUT    300
+#define PROBE_INDIRECT   3
+#define SUSPECT_TIMEOUT  5000
+
+// a removed peer is freed after this many periods, once nothing queued holds it; other threads are done with it by then
+#define GRAVE_PERIODS    10
+
+/* Updates about the state of peers ride along with probes and their responses, in network byte order:
+ *   number of updates (1)
+ * followed by each update:
+ *   state (1), incarnation (4), name length (1), name
+ * Each update is sent about UPDATE_REPEAT * log2(N) times, which reaches every peer with high probability. */
+#define UPDATE_QUEUE   64
+#define UPDATE_REPEAT  3
+
+// probes requested by other peers, waiting for the probe thread
+#define PROBE_QUEUE_SIZE  64
+
+// messages at least this long are compressed for peers that accept it; smaller ones aren't worth the time
+#define COMPRESS_THRESHOLD  128
+
+/* Lines of the log are formatted by the thread that logs them, then queued for the log thread,
+ * which writes them out every LOG_FLUSH_INTERVAL milliseconds; errors are written out at once.
+ * Lines beyond LOG_QUEUE_SIZE are dropped and counted, and a line is cut short at LOG_LINE_SIZE. */
+#define LOG_QUEUE_SIZE      512
+#define LOG_LINE_SIZE       192
+#define LOG_FLUSH_INTERVAL  100
+
+// the temporary file logged to when yell_start() is given no log is emptied once it grows past this
+#define LOG_FILE_SIZE  (1024 * 1024)
+
+// levels of the log; lines above YELL_LOG_LEVEL aren't compiled in
+#define YELL_LOG_ERROR  0  // self can't do what it was asked
+#define YELL_LOG_WARN   1  // a peer misbehaved, or something was dropped
+#define YELL_LOG_INFO   2  // the membership changed, or self exited
+#define YELL_LOG_DEBUG  3
+
+#ifndef YELL_LOG_LEVEL
+#define YELL_LOG_LEVEL  YELL_LOG_INFO
+#endif
+
+#define yell_log(self, level, ...) \
+	do { \
+		if ((level) <= YELL_LOG_LEVEL) \
+			yell_logmsg((self), (level), __VA_ARGS__); \
+	} while (0)
+
+// room for a peer written by yell_peerstr()
+#define PEERSTR_SIZE  (NAME_SIZE + INET_ADDRSTRLEN + 8)
+
+// flags of an event
+#define YEF_DATAGRAM  0x01  // received as a datagram, which may have been lost, duplicated or reordered
+#define YEF_GOSSIP    0x02  // gossiped to self by another peer than its origin, or by the origin itself
+#define YEF_FAILED    0x04  // of a YET_DISCONNECT, the peer stopped responding instead of leaving
+
 enum yell_eventtype {
 	YET_UNKNOWN    = '\0',
 	YET_SUCCESS    = 's',
@@ -32,24 +200,261 @@ enum yell_eventtype {
 	YET_WHOAREYOU  = 'w',
 	YET_MESSAGE    = 'm',
 	YET_CONNECT    = 'c',
-	YET_DISCONNECT = 'd'
+	YET_DISCONNECT = 'd',
+	YET_GOSSIP     = 'g',
+	YET_PROBE      = 'r',
+	YET_PROBEREQ   = 'q',
+	YET_PROBEACK   = 'k'
+};
+
+// the state of a peer, as far as self knows; a peer that has failed or left is removed
+enum yell_peerstate {
+	YPS_ALIVE,
+	YPS_SUSPECT,
+	YPS_FAILED,
+	YPS_LEFT
+};
+
+// counters of what was sent to and received from a peer, or from every peer
+struct yell_counters {
+	uint64_t sent, sent_bytes;           // messages and bytes sent, by stream or datagram
+	uint64_t received, received_bytes;   // messages and bytes received
+	uint64_t failures;                   // sends to which the peer didn't respond, other than probes
+	uint64_t reconnects;                 // connections opened after the first
+	uint64_t dropped;                    // datagrams dropped because a socket buffer or an event queue was full
+};
+
+// the same counters, added to without locking
+struct yell_atomiccounters {
+	_Atomic uint64_t sent, sent_bytes;
+	_Atomic uint64_t received, received_bytes;
+	_Atomic uint64_t failures;
+	_Atomic uint64_t reconnects;
+	_Atomic uint64_t dropped;
 };
 
 struct yell_peer {
 	char name[NAME_SIZE + 1];
 	struct sockaddr_in sockaddr;
 	int sockport;
+
+	// pooled connection to this peer; -1 when closed
+	int sockfd;
+	time_t last_used;
+	pthread_mutex_t mutex;
+
+	// response being received on the pooled connection
+	char in[FRAME_SIZE];
+	int inlen;
+
+	/* Messages are queued while the previous batch is sent, so there are two buffers.
+	 * The queue is guarded by queue_mutex, and the batch by mutex. */
+	char buffers[2][PEER_QUEUE_SIZE];
+	char *queue, *batch;
+	int queuelen, lastframe, queuecount;
+	struct timespec queued_at;
+	pthread_mutex_t queue_mutex;
+
+	// the peer accepts compressed frames, as it said during the YET_WHOAREYOU handshake
+	_Atomic int lz;
+
+	/* Membership: the incarnation is raised by the peer to refute suspicion of it.
+	 * state may be read without locking; the rest is guarded by members_mutex.
+	 * acked is set when another peer acknowledges a probe of this peer made on behalf of self. */
+	_Atomic int state;
+	uint32_t incarnation;
+	struct timespec suspected_at;
+	_Atomic int acked;
+
+	// statistics; connected is set once the first connection is opened, and round trips are in microseconds
+	struct yell_atomiccounters counters;
+	int connected;
+	_Atomic uint64_t rtt_count, rtt_sum, rtt_max;
+
+	// events, jobs, probe requests and gossip queued with this peer; removed_at is when it went to the graveyard
+	_Atomic int refs;
+	struct timespec removed_at;
 };
 
+// state of a peer during a fan-out
+enum yell_sendstate {
+	YSS_WAITING,     // the peer is locked by another thread; nothing was sent yet
+	YSS_CONNECTING,
+	YSS_SENDING,
+	YSS_RECEIVING,
+	YSS_DONE
+};
+
+// the outcome of sending a packet to one peer
+struct yell_result {
+	struct yell_peer *peer;
+	int status;                   // YELL_SUCCESS or YELL_FAILURE
+	enum yell_eventtype reply;    // type of the response
+	char *response;               // if not NULL, receives the response frame (FRAME_SIZE bytes)
+
+	// used by yell_fanout(); iov is the message being sent, and outiov and outoff are how much of it was sent
+	enum yell_sendstate state;
+	const struct iovec *iov;
+	struct iovec queued;
+	int iovcnt, outiov, reused, progress;
+	size_t outoff;
+
+	// the number of messages in iov
+	int nmessages;
+};
+
+// a message of any length as frames, sent straight from the message with sendmsg()
+struct yell_message {
+	struct iovec *iov;
+	int iovcnt;
+
+	// headers of the frames of a large message; a message that fits in one frame is made into packet
+	char *headers;
+	char packet[FRAME_SIZE];
+	struct iovec small;
+
+	// the frame compressed, for peers that accept it; only a message that fits in one frame is compressed
+	int compressed;
+	char lzpacket[FRAME_SIZE];
+	struct iovec lz;
+
+	// probes and their requests and acknowledgements aren't counted as messages sent
+	int membership;
+};
+
+// a connection accepted by the listener
+struct yell_conn {
+	int sockfd;
+	struct sockaddr_in sockaddr;
+	time_t last_used;
+
+	// received bytes that don't yet form a whole frame
+	char in[CONN_BUFFER_SIZE];
+	int inlen;
+
+	// responses that haven't been written yet
+	char out[CONN_BUFFER_SIZE];
+	int outlen, outoff;
+
+	// the payload of a message received in chunks, until its last chunk
+	char *chunks;
+	size_t chunklen, chunksize;
+};
+
+// events are released with yell_freeevent()
 struct yell_event {
-	char packet[PACKET_SIZE + 1];
+	// the payload, which may hold any bytes; a null character follows it for convenience
+	char *packet;
+	size_t length;
 	enum yell_eventtype type;
 	struct yell_peer *peer;
+	int flags;
+
+	// the pool this event came from
+	int sizeclass;
+};
+
+struct yell;
+
+// the outcome of a message submitted with yell_submit()
+struct yell_completion {
+	void *arg;
+	struct yell_peer *peer;   // NULL if the message was sent to every peer
+	int status;               // YELL_SUCCESS if every peer responded
+	int npeers, nfailed;
+};
+
+// a message submitted to one or more peers; it completes once every peer has responded or failed
+struct yell_submit {
+	struct yell_message message;
+	char *copy;
+
+	void (*done)(struct yell *, const struct yell_completion *);
+	struct yell_completion completion;
+
+	_Atomic int remaining, nfailed;
+};
+
+// a submitted message to be sent to one peer
+struct yell_job {
+	struct yell_peer *peer;
+	struct yell_submit *submit;
+};
+
+// a thread with its own queue; fd is a semaphore that counts what has been queued
+struct yell_worker {
+	struct yell *self;
+	pthread_t thread;
+	struct yell_RB queue;
+	int fd;
+};
+
+// statistics of one peer, as of a snapshot
+struct yell_peerstats {
+	char name[NAME_SIZE + 1];
+	struct sockaddr_in sockaddr;
+	int state;
+
+	struct yell_counters counters;
+	int queued;                          // bytes queued for the peer
+
+	uint64_t rtt_count, rtt_mean, rtt_max;  // round trips of yell_topeer(), in microseconds
+};
+
+// a snapshot of the statistics of self, taken by yell_stats() and freed by yell_freestats()
+struct yell_stats {
+	struct yell_counters counters;       // of every peer, including those removed
+
+	// the depths of the queues of self: events for yell_nextevent(), events for the workers, sends for the senders,
+	// gossip to forward, probes requested, and completions for yell_nextcompletion()
+	size_t events, work, jobs, gossip, probes, completions;
+
+	// slabs of the pools, and objects free in them
+	size_t event_slabs, event_free, peer_slabs, peer_free, submit_slabs, submit_free;
+
+	// round trips of yell_topeer(), and of probes, in microseconds
+	struct yell_HG rtt, probe_rtt;
+
+	struct yell_peerstats *peers;
+	int npeers;
+};
+
+// an update about the state of a peer, to be sent along with probes
+struct yell_update {
+	char name[NAME_SIZE + 1];
+	int state;
+	uint32_t incarnation;
+	int transmits;
+};
+
+// a probe of target requested by another peer, which is acknowledged if target responds
+struct yell_probereq {
+	struct yell_peer *target, *requester;
+};
+
+// gossip to be forwarded to peers other than the one it came from and its origin
+struct yell_forward {
+	struct yell_message *msg;
+	struct yell_peer *from, *origin;
+};
+
+// a line of the log, waiting for the log thread
+struct yell_logline {
+	int length;
+	char text[LOG_LINE_SIZE];
 };
 
 struct yell {
 	FILE *log;
 
+	// the log is written out by the log thread once log_async is set; until then, it is written by whoever logs
+	int log_owned, log_fd;
+	_Atomic int log_async, log_close;
+	pthread_mutex_t log_mutex;
+	pthread_t log_thread;
+	struct yell_RB logs;
+	_Atomic uint64_t log_dropped;
+
 	char name[NAME_SIZE + 1];
 
 	int close;
@@ -58,28 +463,183 @@ struct yell {
 	int sockfd, sockport;
 	struct sockaddr_in sockaddr;
 
+	// unreliable datagrams are sent and received on the same port
+	int udpfd;
+
+	// datagrams the system dropped for want of room on receive so far, as last told; only the listener reads it
+	uint32_t udp_overflows;
+
+	// the listener multiplexes every socket with epoll; wakefd interrupts it
+	int epollfd, wakefd;
+
 	pthread_t listen_thread;
 	int (*event_handler)(struct yell *, struct yell_event *);
 
-	struct yell_LL events, peers;
-	pthread_mutex_t events_mutex, peers_mutex;
+	// the event handler is called by the workers, so that the listener only does network I/O
+	struct yell_worker workers[EVENT_WORKERS];
+
+	// events are pushed by the listener and popped by the application without locking
+	struct yell_RB events;
+	int event_fd;
+
+	struct yell_LL peers;
+	pthread_mutex_t peers_mutex;
+
+	// events and peers are allocated from and released to these pools
+	struct yell_MP event_pools[EVENT_CLASSES], peer_pool;
+
+	// peers are listed in the order they were added, and indexed by name and by ADDR:PORT
+	struct yell_HT peers_byname, peers_byaddr;
+
+	// reused by yell_broadcast() for each fan-out to every peer
+	struct yell_result *fanout;
+	struct pollfd *fanout_fds;
+	int fanout_size;
+	pthread_mutex_t fanout_mutex;
+
+	// submitted messages are sent by the sender threads; without a callback, their completions are queued
+	struct yell_worker senders[SEND_WORKERS];
+	struct yell_MP submit_pool;
+	struct yell_RB completions;
+	int completion_fd;
+
+	// queued messages are sent by the flush thread once they have waited long enough; flush_fd wakes it
+	int batch_window, batch_bytes;
+	pthread_t flush_thread;
+	int flush_fd;
+
+	// ids of the gossip seen most recently, indexed by id
+	uint64_t gossip_ids[GOSSIP_HISTORY];
+	int gossip_nids;
+	struct yell_HT gossip_seen;
+	uint64_t gossip_next;
+	unsigned int gossip_seed;
+	pthread_mutex_t gossip_mutex;
+
+	// gossip is forwarded by its own thread, woken by gossip_fd
+	pthread_t gossip_thread;
+	struct yell_RB gossip;
+	int gossip_fd;
+
+	// the incarnation of self, and updates to be sent along with probes; guarded by members_mutex
+	uint32_t incarnation;
+	struct yell_update updates[UPDATE_QUEUE];
+	int nupdates;
+	pthread_mutex_t members_mutex;
+
+	// peers are probed by the probe thread, woken by probe_fd for probes requested by other peers
+	pthread_t probe_thread;
+	struct yell_RB probes;
+	int probe_fd, probe_next;
+
+	// removed peers are kept for GRAVE_PERIODS, and for as long as they are held, since other threads may still point to them
+	struct yell_LL graveyard;
+
+	// statistics of every peer, including those removed; round trips are in microseconds, and probes are kept apart
+	struct yell_atomiccounters counters;
+	struct yell_HG rtt, probe_rtt;
 };
 
+struct yell_peer  *yell_createpeer(struct yell *self, const char *name, struct sockaddr_in sockaddr, int sockport);
+void               yell_freepeer(struct yell *self, struct yell_peer *peer);
+void               yell_holdpeer(struct yell_peer *peer);
+void               yell_releasepeer(struct yell_peer *peer);
+const void        *yell_peername(const void *peer);
+const void        *yell_peeraddr(const void *peer);
+size_t             yell_addrhash(const void *sockaddr);
+int                yell_addrmatch(const void *sockaddr, const void *other);
+int                yell_namematch(const void *name, const void *other);
 struct yell_peer  *yell_findpeer(struct yell *self, const char *name);
-int                yell_pushpeer(struct yell *self, struct yell_peer *peer);
-int                yell_topeer(struct yell *self, struct yell_peer *peer, enum yell_eventtype type, const char *message, char *response);
+struct yell_peer  *yell_findaddr(struct yell *self, struct sockaddr_in sockaddr);
+struct yell_peer  *yell_pushpeer(struct yell *self, struct yell_peer *peer);
+int                yell_openpeer(struct yell *self, struct yell_peer *peer);
+void               yell_closepeer(struct yell_peer *peer);
+void               yell_evictpeers(struct yell *self);
+int                yell_makepacket(struct yell *self, char *packet, enum yell_eventtype type, const char *message, size_t length);
+int                yell_makemessage(struct yell *self, struct yell_message *msg, enum yell_eventtype type, const char *message, size_t length);
+void               yell_freemessage(struct yell_message *msg);
+void               yell_startsend(struct yell *self, struct yell_result *result);
+int                yell_stepsend(struct yell_result *result, short revents);
+int                yell_trypeers(struct yell *self, struct yell_result *results, int npeers, const struct yell_message *msg, int elapsed, int timeout);
+int                yell_fanout(struct yell *self, struct yell_result *results, struct pollfd *fds, int npeers, const struct yell_message *msg);
+int                yell_fanoutwithin(struct yell *self, struct yell_result *results, struct pollfd *fds, int npeers, const struct yell_message *msg, int timeout);
+void               yell_takequeue(struct yell_result *result);
+int                yell_queuepacket(struct yell_peer *peer, const char *packet, int len);
+int                yell_startworker(struct yell *self, struct yell_worker *worker, size_t capacity, size_t elemsize, void *(*run)(void *));
+int                yell_pushwork(struct yell_worker *worker, const void *elem);
+int                yell_waitwork(struct yell_worker *worker, void *elem);
+void               yell_stopworkers(struct yell_worker *workers, int nworkers);
+void               yell_pushjob(struct yell *self, struct yell_job *job);
+void               yell_finishjob(struct yell *self, struct yell_submit *submit, int failed);
+int                yell_topeer(struct yell *self, struct yell_peer *peer, enum yell_eventtype type, const char *message, size_t length, char *response);
+int                yell_topeerwithin(struct yell *self, struct yell_peer *peer, enum yell_eventtype type, const char *message, size_t length, char *response, int timeout);
+int                yell_pickpeers(struct yell *self, struct yell_result *results, int npicks, struct yell_peer *exclude, struct yell_peer *origin);
+void               yell_putupdate(struct yell *self, const char *name, int state, uint32_t incarnation);
+size_t             yell_packupdates(struct yell *self, char *buf, size_t size);
+void               yell_readupdates(struct yell *self, const char *buf, size_t length);
+void               yell_suspect(struct yell *self, struct yell_peer *peer);
+void               yell_markdead(struct yell *self, struct yell_peer *peer, int state, int notify);
+void               yell_removedead(struct yell *self);
+int                yell_probe(struct yell *self, struct yell_peer *peer);
+int                yell_requestprobes(struct yell *self, struct yell_peer *target);
+struct yell_peer  *yell_nextprobe(struct yell *self);
 
-struct yell_event *yell_makeevent(struct yell *self, const char *packet, struct sockaddr_in sockaddr);
+struct yell_event *yell_allocevent(struct yell *self, size_t length);
+void               yell_freeevent(struct yell *self, struct yell_event *event);
+struct yell_event *yell_makeevent(struct yell *self, const struct yell_frame *frame, struct sockaddr_in sockaddr);
 int                yell_pushevent(struct yell *self, struct yell_event *event);
 struct yell_event *yell_nextevent(struct yell *self);
+struct yell_event *yell_waitevent(struct yell *self, int timeout);
+int                yell_eventfd(struct yell *self);
+void               yell_dispatch(struct yell *self, struct yell_event *event);
+int                yell_hasroom(struct yell *self, size_t nevents);
+const void        *yell_gossipid(const void *id);
+size_t             yell_idhash(const void *id);
+int                yell_idmatch(const void *id, const void *other);
+int                yell_seengossip(struct yell *self, uint64_t id);
+int                yell_spreadgossip(struct yell *self, const struct yell_message *msg, struct yell_peer *exclude, struct yell_peer *origin);
+int                yell_recvgossip(struct yell *self, struct yell_event *event);
+int                yell_respond(struct yell *self, struct yell_conn *conn, const struct yell_frame *frame);
+int                yell_recvchunk(struct yell *self, struct yell_conn *conn, const struct yell_frame *frame);
+int                yell_inflate(struct yell *self, struct yell_frame *frame, char *buf);
+int                yell_evictconn(struct yell_conn **conns, int nconns);
+int                yell_readconn(struct yell *self, struct yell_conn *conn);
+int                yell_writeconn(struct yell *self, struct yell_conn *conn);
+void               yell_readdatagrams(struct yell *self);
 
+void               yell_closefds(struct yell *self);
 int                yell_start(FILE *log, struct yell *self, const char *name, int (*event_handler)(struct yell *, struct yell_event *));
+struct yell_peer  *yell_addpeer(struct yell *self, const char *addr, int port);
+int                yell_readpeers(struct yell *self, const struct yell_frame *frame, struct yell_peer ***candidates, int *ncandidates, int *size);
+int                yell_introduce(struct yell *self, struct yell_peer ***candidates, int *ncandidates, int *size, enum yell_eventtype type);
 int                yell_connect(struct yell *self, const char *addr, int port);
+int                yell_snapshot(struct yell *self);
+int                yell_broadcast(struct yell *self, const char *message, size_t length, struct yell_result *results, int nresults);
 int                yell(struct yell *self, const char *message);
+int                yell_datagram(struct yell *self, const char *message, size_t length);
+int                yell_gossip(struct yell *self, const char *message, size_t length);
+void               yell_setbatch(struct yell *self, int window, int bytes);
+int                yell_queue(struct yell *self, const char *message, size_t length);
+int                yell_flush(struct yell *self);
+int                yell_submit(struct yell *self, struct yell_peer *peer, const char *message, size_t length, void (*done)(struct yell *, const struct yell_completion *), void *arg);
+int                yell_nextcompletion(struct yell *self, struct yell_completion *completion);
+int                yell_completionfd(struct yell *self);
 void               yell_exit(struct yell *self);
 
 void               yell_peerf(FILE *file, const char *format, const char *name, struct sockaddr_in sockaddr);
 void               yell_debugf(FILE *file, struct yell *self);
+void               yell_count(_Atomic uint64_t *counter, _Atomic uint64_t *total, uint64_t n);
+void               yell_countrtt(struct yell *self, struct yell_peer *peer, uint64_t rtt);
+void               yell_readcounters(struct yell_counters *counters, struct yell_atomiccounters *from);
+int                yell_stats(struct yell *self, struct yell_stats *stats);
+void               yell_freestats(struct yell_stats *stats);
+void               yell_statsf(FILE *file, struct yell *self);
 void               yell_logf(FILE *file, struct yell *self);
+void               yell_logmsg(struct yell *self, int level, const char *format, ...);
+void               yell_writelog(struct yell *self, const char *text, size_t length);
+void               yell_flushlog(struct yell *self);
+void               yell_startlog(struct yell *self);
+void               yell_stoplog(struct yell *self);
+const char        *yell_peerstr(char *buf, const char *name, struct sockaddr_in sockaddr);
 
 #endif
@@ -0,0 +1,100 @@
+#include "yell_HG.h"
+
+static int yell_HG_bucket(uint64_t value) {
+	int top, shift;
+
+	if (value > UINT32_MAX)
+		value = UINT32_MAX;
+
+	// small values have a bucket each
+	if (value < 1 << YELL_HG_SUBBITS)
+		return value;
+
+	top = 63 - __builtin_clzll(value);
+	shift = top - YELL_HG_SUBBITS;
+
+	return ((shift + 1) << YELL_HG_SUBBITS) + (value >> shift) - (1 << YELL_HG_SUBBITS);
+}
+
+// the middle of the values recorded in the bucket
+static uint64_t yell_HG_value(int bucket) {
+	int shift;
+
+	if (bucket < 1 << YELL_HG_SUBBITS)
+		return bucket;
+
+	shift = (bucket >> YELL_HG_SUBBITS) - 1;
+
+	return ((uint64_t)((1 << YELL_HG_SUBBITS) + (bucket & ((1 << YELL_HG_SUBBITS) - 1))) << shift) + ((1ULL << shift) >> 1);
+}
+
+void yell_HG_init(struct yell_HG *HG) {
+	int i;
+
+	for (i = 0; i < YELL_HG_BUCKETS; ++i)
+		atomic_init(&HG->counts[i], 0);
+
+	atomic_init(&HG->total, 0);
+	atomic_init(&HG->sum, 0);
+	atomic_init(&HG->max, 0);
+}
+
+void yell_HG_record(struct yell_HG *HG, uint64_t value) {
+	uint64_t max;
+
+	// the counts are only summed up, so their order doesn't matter
+	atomic_fetch_add_explicit(&HG->counts[yell_HG_bucket(value)], 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&HG->total, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&HG->sum, value, memory_order_relaxed);
+
+	for (max = atomic_load_explicit(&HG->max, memory_order_relaxed); value > max; )
+		if (atomic_compare_exchange_weak_explicit(&HG->max, &max, value, memory_order_relaxed, memory_order_relaxed))
+			break;
+}
+
+// copies the histogram while it may be recorded to; the copy is consistent with itself, if not quite current
+void yell_HG_copy(struct yell_HG *HG, const struct yell_HG *from) {
+	uint64_t total;
+	int i;
+
+	for (total = 0, i = 0; i < YELL_HG_BUCKETS; ++i) {
+		atomic_init(&HG->counts[i], atomic_load_explicit(&from->counts[i], memory_order_relaxed));
+		total += HG->counts[i];
+	}
+
+	atomic_init(&HG->total, total);
+	atomic_init(&HG->sum, atomic_load_explicit(&from->sum, memory_order_relaxed));
+	atomic_init(&HG->max, atomic_load_explicit(&from->max, memory_order_relaxed));
+}
+
+// percentile is between 0 and 100; returns 0 if nothing was recorded
+uint64_t yell_HG_percentile(const struct yell_HG *HG, double percentile) {
+	uint64_t total, rank, seen, value;
+	int i;
+
+	total = atomic_load_explicit(&HG->total, memory_order_relaxed);
+
+	if (total == 0)
+		return 0;
+
+	// the rank of the value at the percentile, counting from 1, rounded up
+	rank = (uint64_t)(percentile / 100 * total);
+
+	if ((double)rank < percentile / 100 * total || rank < 1)
+		++rank;
+
+	if (rank > total)
+		rank = total;
+
+	for (seen = 0, i = 0; i < YELL_HG_BUCKETS; ++i) {
+		seen += atomic_load_explicit(&HG->counts[i], memory_order_relaxed);
+
+		if (seen >= rank)
+			break;
+	}
+
+	// no value is reported as more than the largest recorded
+	value = yell_HG_value(i < YELL_HG_BUCKETS ? i : YELL_HG_BUCKETS - 1);
+
+	return value < atomic_load_explicit(&HG->max, memory_order_relaxed) ? value : atomic_load_explicit(&HG->max, memory_order_relaxed);
+}
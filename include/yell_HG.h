@@ -0,0 +1,27 @@
+/***************
+ ** histogram **
+ ***************/
+
+#ifndef YELL_HG_H
+#define YELL_HG_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/* A log-linear histogram of values, in the manner of HdrHistogram: each power of two is split into
+ * 2^YELL_HG_SUBBITS buckets, so a value is recorded to within 1/2^YELL_HG_SUBBITS of itself.
+ * Values are recorded without locking, and may be up to 2^32 - 1; larger values are recorded as that. */
+#define YELL_HG_SUBBITS  4
+#define YELL_HG_BUCKETS  ((32 - YELL_HG_SUBBITS + 1) << YELL_HG_SUBBITS)
+
+struct yell_HG {
+	_Atomic uint64_t counts[YELL_HG_BUCKETS];
+	_Atomic uint64_t total, sum, max;
+};
+
+void yell_HG_init(struct yell_HG *HG);
+void yell_HG_record(struct yell_HG *HG, uint64_t value);
+void yell_HG_copy(struct yell_HG *HG, const struct yell_HG *from);
+uint64_t yell_HG_percentile(const struct yell_HG *HG, double percentile);
+
+#endif
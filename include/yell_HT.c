@@ -0,0 +1,185 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "yell_HT.h"
+
+#define YELL_HT_MINSLOTS  16
+
+// marks a slot whose data was removed, so that probing continues past it
+static char tombstone;
+#define YELL_HT_TOMB  ((void *)&tombstone)
+
+int yell_HT_init(struct yell_HT *HT, const void *(*key)(const void *), size_t (*hash)(const void *), int (*match)(const void *, const void *)) {
+	HT->slots = (void **)calloc(YELL_HT_MINSLOTS, sizeof(void *));
+
+	// memory allocation error
+	if (HT->slots == NULL)
+		return YELL_HT_FAILURE;
+
+	HT->nslots = YELL_HT_MINSLOTS;
+	HT->count = 0;
+	HT->ntombs = 0;
+
+	HT->key = key;
+	HT->hash = hash;
+	HT->match = match;
+
+	return YELL_HT_SUCCESS;
+}
+
+void yell_HT_free(struct yell_HT *HT) {
+	free(HT->slots);
+
+	HT->slots = NULL;
+	HT->nslots = 0;
+	HT->count = 0;
+	HT->ntombs = 0;
+}
+
+// the index of the slot holding key, or of the slot where it belongs
+static size_t yell_HT_probe(struct yell_HT *HT, const void *key, int *found) {
+	size_t i, mask, tomb;
+	void *data;
+
+	mask = HT->nslots - 1;
+	tomb = HT->nslots;
+
+	for (i = HT->hash(key) & mask;; i = (i + 1) & mask) {
+		data = HT->slots[i];
+
+		if (data == NULL) {
+			*found = 0;
+
+			// reuse the first tombstone passed
+			return tomb != HT->nslots ? tomb : i;
+		}
+
+		if (data == YELL_HT_TOMB) {
+			if (tomb == HT->nslots)
+				tomb = i;
+
+			continue;
+		}
+
+		if (HT->match(HT->key(data), key)) {
+			*found = 1;
+
+			return i;
+		}
+	}
+}
+
+// rebuild the table with nslots slots, which drops every tombstone
+static int yell_HT_resize(struct yell_HT *HT, size_t nslots) {
+	void **slots, *data;
+	size_t i, j, mask;
+
+	slots = (void **)calloc(nslots, sizeof(void *));
+
+	// memory allocation error
+	if (slots == NULL)
+		return YELL_HT_FAILURE;
+
+	mask = nslots - 1;
+
+	for (i = 0; i < HT->nslots; ++i) {
+		data = HT->slots[i];
+
+		if (data == NULL || data == YELL_HT_TOMB)
+			continue;
+
+		for (j = HT->hash(HT->key(data)) & mask; slots[j] != NULL; j = (j + 1) & mask)
+			;
+
+		slots[j] = data;
+	}
+
+	free(HT->slots);
+
+	HT->slots = slots;
+	HT->nslots = nslots;
+	HT->ntombs = 0;
+
+	return YELL_HT_SUCCESS;
+}
+
+// data whose key is already in the table replaces the old data, which is given in replaced
+int yell_HT_insert(struct yell_HT *HT, void *data, void **replaced) {
+	size_t i, nslots;
+	int found;
+
+	if (replaced != NULL)
+		*replaced = NULL;
+
+	// keep the table at most half full, counting tombstones
+	if ((HT->count + HT->ntombs + 1) * 2 > HT->nslots) {
+		// grow only if the live data needs it; otherwise clearing tombstones is enough
+		for (nslots = YELL_HT_MINSLOTS; (HT->count + 1) * 2 > nslots / 2; nslots *= 2)
+			;
+
+		if (nslots < HT->nslots)
+			nslots = HT->nslots;
+
+		if (yell_HT_resize(HT, nslots) == YELL_HT_FAILURE)
+			return YELL_HT_FAILURE;
+	}
+
+	i = yell_HT_probe(HT, HT->key(data), &found);
+
+	if (found) {
+		if (replaced != NULL)
+			*replaced = HT->slots[i];
+	} else {
+		if (HT->slots[i] == YELL_HT_TOMB)
+			--HT->ntombs;
+
+		++HT->count;
+	}
+
+	HT->slots[i] = data;
+
+	return YELL_HT_SUCCESS;
+}
+
+void *yell_HT_find(struct yell_HT *HT, const void *key) {
+	size_t i;
+	int found;
+
+	i = yell_HT_probe(HT, key, &found);
+
+	return found ? HT->slots[i] : NULL;
+}
+
+void *yell_HT_remove(struct yell_HT *HT, const void *key) {
+	void *data;
+	size_t i;
+	int found;
+
+	i = yell_HT_probe(HT, key, &found);
+
+	if (!found)
+		return NULL;
+
+	data = HT->slots[i];
+
+	HT->slots[i] = YELL_HT_TOMB;
+	--HT->count;
+	++HT->ntombs;
+
+	return data;
+}
+
+// FNV-1a hash of a string
+size_t yell_HT_strhash(const void *key) {
+	const unsigned char *c;
+	size_t hash;
+
+	hash = (size_t)14695981039346656037ULL;
+
+	for (c = (const unsigned char *)key; *c != '\0'; ++c) {
+		hash ^= *c;
+		hash *= (size_t)1099511628211ULL;
+	}
+
+	return hash;
+}
@@ -0,0 +1,31 @@
+/****************
+ ** hash table **
+ ****************/
+
+#ifndef YELL_HT_H
+#define YELL_HT_H
+
+#include <stddef.h>
+
+#define YELL_HT_SUCCESS  0
+#define YELL_HT_FAILURE  1
+
+// open addressing with linear probing; data is found by a key that is derived from it
+struct yell_HT {
+	void **slots;
+	size_t nslots, count, ntombs;
+
+	const void *(*key)(const void *data);
+	size_t (*hash)(const void *key);
+	int (*match)(const void *key, const void *other);
+};
+
+int yell_HT_init(struct yell_HT *HT, const void *(*key)(const void *), size_t (*hash)(const void *), int (*match)(const void *, const void *));
+void yell_HT_free(struct yell_HT *HT);
+int yell_HT_insert(struct yell_HT *HT, void *data, void **replaced);
+void *yell_HT_find(struct yell_HT *HT, const void *key);
+void *yell_HT_remove(struct yell_HT *HT, const void *key);
+
+size_t yell_HT_strhash(const void *key);
+
+#endif
@@ -136,3 +136,28 @@ void *yell_LL_remove(struct yell_LL *LL, int index) {
 
 	return data;
 }
+
+// removes the first node holding data
+int yell_LL_delete(struct yell_LL *LL, void *data) {
+	struct yell_LL_node *node, *prev;
+
+	for (prev = NULL, node = LL->head; node != NULL && node->data != data; prev = node, node = node->next)
+		;
+
+	// data isn't in the linked list
+	if (node == NULL)
+		return YELL_LL_FAILURE;
+
+	if (prev == NULL)
+		LL->head = node->next;
+	else
+		prev->next = node->next;
+
+	// check if this node is the tail
+	if (node == LL->tail)
+		LL->tail = prev;
+
+	free(node);
+
+	return YELL_LL_SUCCESS;
+}
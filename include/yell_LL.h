@@ -20,5 +20,6 @@ struct yell_LL {
 
 int yell_LL_insert(struct yell_LL *LL, int index, void *data);
 void *yell_LL_remove(struct yell_LL *LL, int index);
+int yell_LL_delete(struct yell_LL *LL, void *data);
 
 #endif
@@ -0,0 +1,192 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "yell_LZ.h"
+
+static uint32_t yell_LZ_read32(const unsigned char *p) {
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+
+	return v;
+}
+
+static size_t yell_LZ_hash(uint32_t v) {
+	return (v * 2654435761U) >> (32 - YELL_LZ_HASHBITS);
+}
+
+// writes the part of a count that didn't fit in its nibble; returns the new output position, or 0 if there is no room
+static size_t yell_LZ_putcount(unsigned char *dst, size_t op, size_t dstsize, size_t count) {
+	for (count -= 15; count >= 255; count -= 255) {
+		if (op == dstsize)
+			return 0;
+
+		dst[op++] = 255;
+	}
+
+	if (op == dstsize)
+		return 0;
+
+	dst[op++] = count;
+
+	return op;
+}
+
+// returns the position after the sequence, or 0 if there is no room; a match of length 0 ends the data
+static size_t yell_LZ_putsequence(unsigned char *dst, size_t op, size_t dstsize,
+                                  const unsigned char *literals, size_t nliterals, size_t offset, size_t length) {
+	size_t token;
+
+	if (op == dstsize)
+		return 0;
+
+	token = op++;
+	dst[token] = (nliterals < 15 ? nliterals : 15) << 4;
+
+	if (nliterals >= 15 && (op = yell_LZ_putcount(dst, op, dstsize, nliterals)) == 0)
+		return 0;
+
+	if (op + nliterals > dstsize)
+		return 0;
+
+	memcpy(dst + op, literals, nliterals);
+	op += nliterals;
+
+	if (length == 0)
+		return op;
+
+	if (op + 2 > dstsize)
+		return 0;
+
+	dst[op++] = offset;
+	dst[op++] = offset >> 8;
+
+	length -= YELL_LZ_MINMATCH;
+	dst[token] |= length < 15 ? length : 15;
+
+	if (length >= 15 && (op = yell_LZ_putcount(dst, op, dstsize, length)) == 0)
+		return 0;
+
+	return op;
+}
+
+// returns the compressed size, or YELL_LZ_FAILURE if it doesn't fit in dstsize
+int yell_LZ_compress(const char *src, size_t srclen, char *dst, size_t dstsize) {
+	const unsigned char *in = (const unsigned char *)src;
+	unsigned char *out = (unsigned char *)dst;
+
+	// positions are stored plus one, so that zero is an empty slot
+	uint32_t table[1 << YELL_LZ_HASHBITS];
+	size_t ip, anchor, ref, length, op;
+	uint32_t seq;
+	size_t h;
+
+	memset(table, 0, sizeof(table));
+
+	op = 0;
+	anchor = 0;
+
+	for (ip = 0; ip + YELL_LZ_MINMATCH <= srclen;) {
+		seq = yell_LZ_read32(in + ip);
+		h = yell_LZ_hash(seq);
+
+		ref = table[h];
+		table[h] = ip + 1;
+
+		// no match; skip ahead faster the longer it has been since the last one, so incompressible data is quick
+		if (ref == 0 || ip - (ref - 1) > 65535 || yell_LZ_read32(in + ref - 1) != seq) {
+			ip += 1 + ((ip - anchor) >> 6);
+
+			continue;
+		}
+
+		--ref;
+
+		for (length = YELL_LZ_MINMATCH; ip + length < srclen && in[ref + length] == in[ip + length]; ++length)
+			;
+
+		op = yell_LZ_putsequence(out, op, dstsize, in + anchor, ip - anchor, ip - ref, length);
+
+		if (op == 0)
+			return YELL_LZ_FAILURE;
+
+		ip += length;
+		anchor = ip;
+	}
+
+	// the rest are literals
+	op = yell_LZ_putsequence(out, op, dstsize, in + anchor, srclen - anchor, 0, 0);
+
+	if (op == 0)
+		return YELL_LZ_FAILURE;
+
+	return op;
+}
+
+// returns the decompressed size, or YELL_LZ_FAILURE if the data is invalid or doesn't fit in dstsize
+int yell_LZ_decompress(const char *src, size_t srclen, char *dst, size_t dstsize) {
+	const unsigned char *in = (const unsigned char *)src;
+	unsigned char *out = (unsigned char *)dst;
+
+	size_t ip, op, count, offset;
+	unsigned char token, c;
+
+	for (ip = 0, op = 0; ip < srclen;) {
+		token = in[ip++];
+
+		// literals
+		count = token >> 4;
+
+		if (count == 15) {
+			do {
+				if (ip == srclen)
+					return YELL_LZ_FAILURE;
+
+				c = in[ip++];
+				count += c;
+			} while (c == 255);
+		}
+
+		if (count > srclen - ip || count > dstsize - op)
+			return YELL_LZ_FAILURE;
+
+		memcpy(out + op, in + ip, count);
+		ip += count;
+		op += count;
+
+		// the last sequence has no match
+		if (ip == srclen)
+			break;
+
+		// match
+		if (srclen - ip < 2)
+			return YELL_LZ_FAILURE;
+
+		offset = in[ip] | in[ip + 1] << 8;
+		ip += 2;
+
+		if (offset == 0 || offset > op)
+			return YELL_LZ_FAILURE;
+
+		count = (token & 15) + YELL_LZ_MINMATCH;
+
+		if ((token & 15) == 15) {
+			do {
+				if (ip == srclen)
+					return YELL_LZ_FAILURE;
+
+				c = in[ip++];
+				count += c;
+			} while (c == 255);
+		}
+
+		if (count > dstsize - op)
+			return YELL_LZ_FAILURE;
+
+		// the match may overlap what it is copied to, so copy a byte at a time
+		for (; count > 0; --count, ++op)
+			out[op] = out[op - offset];
+	}
+
+	return op;
+}
@@ -0,0 +1,25 @@
+/*****************
+ ** compression **
+ *****************/
+
+#ifndef YELL_LZ_H
+#define YELL_LZ_H
+
+#include <stddef.h>
+
+#define YELL_LZ_SUCCESS  0
+#define YELL_LZ_FAILURE  -1
+
+/* A byte-oriented LZ77 compressor, in the manner of LZ4; it favours speed over ratio.
+ * The compressed data is a list of sequences, each of which is:
+ *   token (1): literal count in the high nibble, match length minus YELL_LZ_MINMATCH in the low nibble
+ *   more literal count (if 15), literals, match offset (2, little-endian), more match length (if 15)
+ * where a nibble of 15 continues the count in following bytes, each added until one is less than 255.
+ * The last sequence ends after its literals. */
+#define YELL_LZ_MINMATCH  4
+#define YELL_LZ_HASHBITS  10
+
+int yell_LZ_compress(const char *src, size_t srclen, char *dst, size_t dstsize);
+int yell_LZ_decompress(const char *src, size_t srclen, char *dst, size_t dstsize);
+
+#endif
@@ -0,0 +1,109 @@
+#include <stdlib.h>
+
+#include "yell_MP.h"
+
+// every slab starts with a link to the next slab, padded so that objects stay aligned
+#define YELL_MP_ALIGN(size)  (((size) + _Alignof(max_align_t) - 1) / _Alignof(max_align_t) * _Alignof(max_align_t))
+
+int yell_MP_init(struct yell_MP *MP, size_t size, size_t perslab) {
+	// a free object holds the link to the next free object
+	if (size < sizeof(void *))
+		size = sizeof(void *);
+
+	MP->size = YELL_MP_ALIGN(size);
+	MP->perslab = perslab;
+
+	MP->free = NULL;
+	MP->slabs = NULL;
+	MP->nslabs = 0;
+	MP->nfree = 0;
+
+	if (pthread_mutex_init(&MP->mutex, NULL) != 0)
+		return YELL_MP_FAILURE;
+
+	return YELL_MP_SUCCESS;
+}
+
+void yell_MP_free(struct yell_MP *MP) {
+	void *slab, *next;
+
+	for (slab = MP->slabs; slab != NULL; slab = next) {
+		next = *(void **)slab;
+		free(slab);
+	}
+
+	MP->free = NULL;
+	MP->slabs = NULL;
+	MP->nslabs = 0;
+	MP->nfree = 0;
+
+	pthread_mutex_destroy(&MP->mutex);
+}
+
+// MP->mutex must be held
+static int yell_MP_grow(struct yell_MP *MP) {
+	char *slab, *object;
+	size_t i;
+
+	slab = (char *)malloc(YELL_MP_ALIGN(sizeof(void *)) + MP->size * MP->perslab);
+
+	// memory allocation error
+	if (slab == NULL)
+		return YELL_MP_FAILURE;
+
+	*(void **)slab = MP->slabs;
+	MP->slabs = slab;
+	++MP->nslabs;
+
+	// put every object of the slab on the free list
+	for (i = 0; i < MP->perslab; ++i) {
+		object = slab + YELL_MP_ALIGN(sizeof(void *)) + i * MP->size;
+
+		*(void **)object = MP->free;
+		MP->free = object;
+	}
+
+	MP->nfree += MP->perslab;
+
+	return YELL_MP_SUCCESS;
+}
+
+void *yell_MP_alloc(struct yell_MP *MP) {
+	void *object;
+
+	pthread_mutex_lock(&MP->mutex);
+
+	if (MP->free == NULL && yell_MP_grow(MP) == YELL_MP_FAILURE) {
+		pthread_mutex_unlock(&MP->mutex);
+
+		return NULL;
+	}
+
+	object = MP->free;
+	MP->free = *(void **)object;
+	--MP->nfree;
+
+	pthread_mutex_unlock(&MP->mutex);
+
+	return object;
+}
+
+void yell_MP_release(struct yell_MP *MP, void *object) {
+	pthread_mutex_lock(&MP->mutex);
+
+	*(void **)object = MP->free;
+	MP->free = object;
+	++MP->nfree;
+
+	pthread_mutex_unlock(&MP->mutex);
+}
+
+// the number of slabs, and of objects that are free; the rest are in use
+void yell_MP_count(struct yell_MP *MP, size_t *nslabs, size_t *nfree) {
+	pthread_mutex_lock(&MP->mutex);
+
+	*nslabs = MP->nslabs;
+	*nfree = MP->nfree;
+
+	pthread_mutex_unlock(&MP->mutex);
+}
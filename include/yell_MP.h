@@ -0,0 +1,31 @@
+/*****************
+ ** memory pool **
+ *****************/
+
+#ifndef YELL_MP_H
+#define YELL_MP_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+#define YELL_MP_SUCCESS  0
+#define YELL_MP_FAILURE  1
+
+/* Objects of one size are carved out of slabs, and released objects are kept on a free list for reuse;
+ * slabs are only returned to the system by yell_MP_free(). */
+struct yell_MP {
+	size_t size, perslab;
+
+	void *free, *slabs;
+	size_t nslabs, nfree;
+
+	pthread_mutex_t mutex;
+};
+
+int yell_MP_init(struct yell_MP *MP, size_t size, size_t perslab);
+void yell_MP_free(struct yell_MP *MP);
+void *yell_MP_alloc(struct yell_MP *MP);
+void yell_MP_release(struct yell_MP *MP, void *object);
+void yell_MP_count(struct yell_MP *MP, size_t *nslabs, size_t *nfree);
+
+#endif
@@ -0,0 +1,118 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "yell_RB.h"
+
+#define YELL_RB_CELL(RB, i)  ((_Atomic size_t *)((RB)->cells + ((i) & (RB)->mask) * (RB)->cellsize))
+
+// capacity is rounded up to a power of two
+int yell_RB_init(struct yell_RB *RB, size_t capacity, size_t elemsize) {
+	size_t ncells, align, i;
+
+	for (ncells = 2; ncells < capacity; ncells *= 2)
+		;
+
+	// each cell is its sequence number followed by its element, aligned for any type
+	align = _Alignof(max_align_t);
+	RB->cellsize = (sizeof(_Atomic size_t) + elemsize + align - 1) / align * align;
+
+	RB->cells = (char *)malloc(ncells * RB->cellsize);
+
+	// memory allocation error
+	if (RB->cells == NULL)
+		return YELL_RB_FAILURE;
+
+	RB->mask = ncells - 1;
+	RB->elemsize = elemsize;
+
+	// cell i is first ready to be pushed to when the tail is i
+	for (i = 0; i < ncells; ++i)
+		atomic_init(YELL_RB_CELL(RB, i), i);
+
+	atomic_init(&RB->head, 0);
+	atomic_init(&RB->tail, 0);
+
+	return YELL_RB_SUCCESS;
+}
+
+void yell_RB_free(struct yell_RB *RB) {
+	free(RB->cells);
+
+	RB->cells = NULL;
+}
+
+// returns YELL_RB_FAILURE if the ring buffer is full
+int yell_RB_push(struct yell_RB *RB, const void *elem) {
+	_Atomic size_t *cell;
+	size_t tail, seq;
+
+	tail = atomic_load_explicit(&RB->tail, memory_order_relaxed);
+
+	for (;;) {
+		cell = YELL_RB_CELL(RB, tail);
+		seq = atomic_load_explicit(cell, memory_order_acquire);
+
+		if (seq == tail) {
+			// claim the cell
+			if (atomic_compare_exchange_weak_explicit(&RB->tail, &tail, tail + 1,
+			                                          memory_order_relaxed, memory_order_relaxed))
+				break;
+		} else
+		// the cell hasn't been popped since the last lap
+		if ((ptrdiff_t)(seq - tail) < 0)
+			return YELL_RB_FAILURE;
+		else
+			// another thread pushed first
+			tail = atomic_load_explicit(&RB->tail, memory_order_relaxed);
+	}
+
+	memcpy(cell + 1, elem, RB->elemsize);
+
+	// publish the element to poppers
+	atomic_store_explicit(cell, tail + 1, memory_order_release);
+
+	return YELL_RB_SUCCESS;
+}
+
+// returns YELL_RB_FAILURE if the ring buffer is empty
+int yell_RB_pop(struct yell_RB *RB, void *elem) {
+	_Atomic size_t *cell;
+	size_t head, seq;
+
+	head = atomic_load_explicit(&RB->head, memory_order_relaxed);
+
+	for (;;) {
+		cell = YELL_RB_CELL(RB, head);
+		seq = atomic_load_explicit(cell, memory_order_acquire);
+
+		if (seq == head + 1) {
+			// claim the cell
+			if (atomic_compare_exchange_weak_explicit(&RB->head, &head, head + 1,
+			                                          memory_order_relaxed, memory_order_relaxed))
+				break;
+		} else
+		// nothing has been pushed to the cell yet
+		if ((ptrdiff_t)(seq - (head + 1)) < 0)
+			return YELL_RB_FAILURE;
+		else
+			// another thread popped first
+			head = atomic_load_explicit(&RB->head, memory_order_relaxed);
+	}
+
+	memcpy(elem, cell + 1, RB->elemsize);
+
+	// hand the cell back to pushers for the next lap
+	atomic_store_explicit(cell, head + RB->mask + 1, memory_order_release);
+
+	return YELL_RB_SUCCESS;
+}
+
+// only a snapshot; other threads may push or pop at any time
+size_t yell_RB_count(struct yell_RB *RB) {
+	size_t head, tail;
+
+	head = atomic_load_explicit(&RB->head, memory_order_relaxed);
+	tail = atomic_load_explicit(&RB->tail, memory_order_relaxed);
+
+	return tail > head ? tail - head : 0;
+}
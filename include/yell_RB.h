@@ -0,0 +1,32 @@
+/*****************
+ ** ring buffer **
+ *****************/
+
+#ifndef YELL_RB_H
+#define YELL_RB_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+#define YELL_RB_SUCCESS  0
+#define YELL_RB_FAILURE  1
+
+/* A bounded, lock-free queue of fixed-size elements that any number of threads may push to and pop from.
+ * Each cell holds a sequence number, which tells pushers and poppers whose turn it is to use the cell. */
+struct yell_RB {
+	char *cells;
+	size_t mask, elemsize, cellsize;
+
+	// pushers and poppers are kept on separate cache lines
+	_Atomic size_t head;
+	char pad[64 - sizeof(size_t)];
+	_Atomic size_t tail;
+};
+
+int yell_RB_init(struct yell_RB *RB, size_t capacity, size_t elemsize);
+void yell_RB_free(struct yell_RB *RB);
+int yell_RB_push(struct yell_RB *RB, const void *elem);
+int yell_RB_pop(struct yell_RB *RB, void *elem);
+size_t yell_RB_count(struct yell_RB *RB);
+
+#endif
@@ -0,0 +1,96 @@
+#include <string.h>
+
+#include "yell_frame.h"
+
+// writes the header and the name, which the payload of the given length is to follow; returns their size, or -1
+int yell_frame_header(char *buf, size_t size, int type, int flags, const char *name, int port, size_t length) {
+	unsigned char *header = (unsigned char *)buf;
+	size_t namelen;
+
+	namelen = strlen(name);
+
+	// the name length must fit in one byte
+	if (namelen > 255)
+		return YELL_FRAME_FAILURE;
+
+	// the header doesn't fit in the buffer
+	if (YELL_FRAME_HEADER + namelen > size)
+		return YELL_FRAME_FAILURE;
+
+	header[0] = YELL_FRAME_VERSION;
+	header[1] = type;
+	header[2] = flags >> 8;
+	header[3] = flags;
+	header[4] = port >> 8;
+	header[5] = port;
+	header[6] = namelen;
+	header[7] = 0;
+	header[8] = length >> 24;
+	header[9] = length >> 16;
+	header[10] = length >> 8;
+	header[11] = length;
+
+	memcpy(buf + YELL_FRAME_HEADER, name, namelen);
+
+	return YELL_FRAME_HEADER + namelen;
+}
+
+int yell_frame_make(char *buf, size_t size, int type, int flags, const char *name, int port, const char *payload, size_t length) {
+	int len;
+
+	len = yell_frame_header(buf, size, type, flags, name, port, length);
+
+	// the frame doesn't fit in the buffer
+	if (len < 0 || len + length > size)
+		return YELL_FRAME_FAILURE;
+
+	if (length > 0)
+		memcpy(buf + len, payload, length);
+
+	return len + length;
+}
+
+/* Returns the size of the frame at the start of buf, 0 if more bytes are needed,
+ * or YELL_FRAME_FAILURE if the frame is invalid or its payload is larger than maxlength. */
+int yell_frame_parse(const char *buf, size_t len, size_t maxlength, struct yell_frame *frame) {
+	const unsigned char *header = (const unsigned char *)buf;
+
+	// the header hasn't arrived yet
+	if (len < YELL_FRAME_HEADER)
+		return 0;
+
+	if (header[0] != YELL_FRAME_VERSION)
+		return YELL_FRAME_FAILURE;
+
+	frame->type = header[1];
+	frame->flags = header[2] << 8 | header[3];
+	frame->port = header[4] << 8 | header[5];
+	frame->namelen = header[6];
+	frame->length = (size_t)header[8] << 24 | (size_t)header[9] << 16 | (size_t)header[10] << 8 | header[11];
+
+	if (frame->length > maxlength)
+		return YELL_FRAME_FAILURE;
+
+	// the rest of the frame hasn't arrived yet
+	if (len < YELL_FRAME_HEADER + frame->namelen + frame->length)
+		return 0;
+
+	frame->name = buf + YELL_FRAME_HEADER;
+	frame->payload = frame->name + frame->namelen;
+
+	return YELL_FRAME_HEADER + frame->namelen + frame->length;
+}
+
+// changes the flags of a frame that was already made
+void yell_frame_setflags(char *buf, int flags) {
+	unsigned char *header = (unsigned char *)buf;
+
+	header[2] = flags >> 8;
+	header[3] = flags;
+}
+
+int yell_frame_getflags(const char *buf) {
+	const unsigned char *header = (const unsigned char *)buf;
+
+	return header[2] << 8 | header[3];
+}
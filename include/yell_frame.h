@@ -0,0 +1,41 @@
+/*****************
+ ** wire format **
+ *****************/
+
+#ifndef YELL_FRAME_H
+#define YELL_FRAME_H
+
+#include <stddef.h>
+
+#define YELL_FRAME_SUCCESS  0
+#define YELL_FRAME_FAILURE  -1
+
+#define YELL_FRAME_VERSION  1
+
+/* Every frame starts with a fixed header, in network byte order:
+ *   version (1), type (1), flags (2), port (2), name length (1), reserved (1), payload length (4)
+ * followed by the name of the sender, then the payload. */
+#define YELL_FRAME_HEADER  12
+
+// flags of a frame
+#define YELL_FRAME_MORE   0x0001  // more frames follow in the same batch; only the last is responded to
+#define YELL_FRAME_CHUNK  0x0002  // the payload is continued by the next frame, which also has the type and sender of this one
+#define YELL_FRAME_LZ     0x0004  // the payload is compressed with yell_LZ_compress()
+#define YELL_FRAME_LZ_OK  0x0008  // the sender accepts compressed frames; set during the YET_WHOAREYOU handshake
+
+// a frame parsed in place; name and payload point into the parsed buffer
+struct yell_frame {
+	int type, flags, port;
+	const char *name;
+	size_t namelen;
+	const char *payload;
+	size_t length;
+};
+
+int yell_frame_header(char *buf, size_t size, int type, int flags, const char *name, int port, size_t length);
+int yell_frame_make(char *buf, size_t size, int type, int flags, const char *name, int port, const char *payload, size_t length);
+int yell_frame_parse(const char *buf, size_t len, size_t maxlength, struct yell_frame *frame);
+void yell_frame_setflags(char *buf, int flags);
+int yell_frame_getflags(const char *buf);
+
+#endif